@@ -1,6 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "estadisticas.h"
+#include "exportador.h"
+#include "recorrido.h"
+#include "memoria.h"
+#include "cambios.h"
 
 // ESTRUCTURAS DE DATOS//
 // Nodo de la cola FIFO (pedidos)
@@ -8,6 +27,7 @@ typedef struct Pedido {
     char destino[50];
     int cantidad;
     struct Pedido* siguiente;
+    BloqueCompacto* bloque; // Bloque compacto que lo contiene (NULL: malloc propio)
 } Pedido;
 
 // Nodo del árbol AVL
@@ -16,37 +36,217 @@ typedef struct NodoAVL {
     char producto[50];
     int stock;
     Pedido* cabeza;         // Cola FIFO de pedidos
+    Pedido* ultimo;         // Final de la cola (encolar en O(1))
     int altura;
+    atomic_int refs;        // Enlaces que apuntan al nodo (arbol vivo + versiones)
+    BloqueCompacto* bloque; // Bloque compacto que lo contiene (NULL: malloc propio)
     struct NodoAVL* izquierda;
     struct NodoAVL* derecha;
 } NodoAVL;
 
+// Contadores del motor (se llenan solo con la recoleccion encendida)
+#define MUESTRAS_ALTURA 64      // Anillo con la altura cada MUTACIONES_POR_MUESTRA
+#define MUTACIONES_POR_MUESTRA 1024
+
+typedef struct EstadisticasAVL {
+    uint64_t rotacionesLL, rotacionesRR, rotacionesLR, rotacionesRL;
+    uint64_t descensos;             // Busquedas, inserciones y bajas
+    uint64_t nodosVisitados;        // Suma de nodos recorridos en todos los descensos
+    uint64_t nodosCreados, nodosLiberados;
+    uint64_t pedidosCreados, pedidosLiberados;
+    uint64_t copiasPorVersion;      // Nodos clonados por copia en escritura
+    uint64_t mutaciones;
+    int alturas[MUESTRAS_ALTURA];
+    Histograma insertar, eliminar, buscar, despacho, cancelacion;
+} EstadisticasAVL;
+
+EstadisticasAVL estadisticas;
+
+// Memoria de cada estructura (incluye los nodos que solo retienen versiones)
+CuentaMemoria memoriaLotes, memoriaPedidos;
+
+// Lotes dados de alta, de baja o modificados (stock y cola) para los reportes de cambios
+#define LIMITE_CAMBIOS (1 << 20)
+RegistroCambios cambiosLotes = REGISTRO_CAMBIOS(LIMITE_CAMBIOS);
+
+// ================= CALENDARIO DE VENCIMIENTOS =================
+// Rueda de dias junto al AVL: la ranura (ordinal del dia % HORIZONTE_DIAS)
+// apunta al lote que vence ese dia (la fecha es clave unica, asi que hay a
+// lo sumo uno). Cubre [diaBase, diaBase + HORIZONTE_DIAS); los lotes mas
+// lejanos siguen en el AVL y entran a la rueda cuando el dia avanza.
+#define HORIZONTE_DIAS 4096     // Potencia de 2 (~11 años)
+#define PALABRAS_CALENDARIO (HORIZONTE_DIAS / 64)
+
+typedef struct Calendario {
+    int diaBase;                        // Ordinal del dia actual
+    NodoAVL* dias[HORIZONTE_DIAS];
+    uint64_t ocupados[PALABRAS_CALENDARIO];
+    int proximo;                        // Ordinal del proximo vencimiento, -1 si no hay
+    long enHorizonte;
+    long vencidos;                      // Lotes con fecha anterior a hoy
+    long lejanos;                       // Lotes mas alla del horizonte
+    long invalidos;                     // Fechas que no existen en el calendario
+} Calendario;
+
+// Calendario del inventario vivo; NULL mientras no se haya construido
+Calendario* calendarioActivo = NULL;
+
+// Numero de dia desde 1970-01-01 de una fecha AAAAMMDD (calendario gregoriano)
+int ordinalDia(int fecha) {
+    int anio = fecha / 10000, mes = fecha / 100 % 100, dia = fecha % 100;
+    anio -= mes <= 2;
+    int era = (anio >= 0 ? anio : anio - 399) / 400;
+    unsigned anioEra = (unsigned)(anio - era * 400);
+    unsigned diaAnio = (153u * (unsigned)(mes > 2 ? mes - 3 : mes + 9) + 2) / 5 + (unsigned)dia - 1;
+    unsigned diaEra = anioEra * 365 + anioEra / 4 - anioEra / 100 + diaAnio;
+    return era * 146097 + (int)diaEra - 719468;
+}
+
+// Fecha AAAAMMDD de un numero de dia
+int fechaDesdeOrdinal(int ordinal) {
+    ordinal += 719468;
+    int era = (ordinal >= 0 ? ordinal : ordinal - 146096) / 146097;
+    unsigned diaEra = (unsigned)(ordinal - era * 146097);
+    unsigned anioEra = (diaEra - diaEra / 1460 + diaEra / 36524 - diaEra / 146096) / 365;
+    unsigned diaAnio = diaEra - (365 * anioEra + anioEra / 4 - anioEra / 100);
+    unsigned mp = (5 * diaAnio + 2) / 153;
+    int dia = (int)(diaAnio - (153 * mp + 2) / 5 + 1);
+    int mes = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int anio = (int)anioEra + era * 400 + (mes <= 2);
+    return anio * 10000 + mes * 100 + dia;
+}
+
+int fechaValida(int fecha) {
+    int mes = fecha / 100 % 100, dia = fecha % 100;
+    return fecha > 0 && mes >= 1 && mes <= 12 && dia >= 1 &&
+           fechaDesdeOrdinal(ordinalDia(fecha)) == fecha;
+}
+
+int ranuraDia(int ordinal) {
+    return (int)((unsigned)ordinal & (HORIZONTE_DIAS - 1));
+}
+
+// Primer dia ocupado en [desde, diaBase + HORIZONTE_DIAS), o -1
+int buscarDiaOcupado(Calendario* c, int desde) {
+    int fin = c->diaBase + HORIZONTE_DIAS;
+    while (desde < fin) {
+        int ranura = ranuraDia(desde);
+        uint64_t palabra = c->ocupados[ranura / 64] >> (ranura % 64);
+        if (palabra != 0) {
+            int ordinal = desde + __builtin_ctzll(palabra);
+            return ordinal < fin ? ordinal : -1;
+        }
+        desde += 64 - ranura % 64;
+    }
+    return -1;
+}
+
+// Ubicar un lote en la rueda o en el contador que le corresponda
+void clasificarEnCalendario(Calendario* c, NodoAVL* nodo) {
+    if (!fechaValida(nodo->fecha)) {
+        c->invalidos++;
+        return;
+    }
+    int ordinal = ordinalDia(nodo->fecha);
+    if (ordinal < c->diaBase) {
+        c->vencidos++;
+    } else if (ordinal >= c->diaBase + HORIZONTE_DIAS) {
+        c->lejanos++;
+    } else {
+        int ranura = ranuraDia(ordinal);
+        c->dias[ranura] = nodo;
+        c->ocupados[ranura / 64] |= 1ull << (ranura % 64);
+        c->enHorizonte++;
+        if (c->proximo < 0 || ordinal < c->proximo)
+            c->proximo = ordinal;
+    }
+}
+
+// Enganches que mantienen el calendario al dia con el arbol vivo
+void calendarioAgregar(NodoAVL* nodo) {
+    if (calendarioActivo != NULL)
+        clasificarEnCalendario(calendarioActivo, nodo);
+}
+
+// El lote de esta fecha deja de existir
+void calendarioQuitar(int fecha) {
+    Calendario* c = calendarioActivo;
+    if (c == NULL)
+        return;
+    if (!fechaValida(fecha)) {
+        c->invalidos--;
+        return;
+    }
+    int ordinal = ordinalDia(fecha);
+    if (ordinal < c->diaBase) {
+        c->vencidos--;
+    } else if (ordinal >= c->diaBase + HORIZONTE_DIAS) {
+        c->lejanos--;
+    } else {
+        int ranura = ranuraDia(ordinal);
+        c->dias[ranura] = NULL;
+        c->ocupados[ranura / 64] &= ~(1ull << (ranura % 64));
+        c->enHorizonte--;
+        if (ordinal == c->proximo)
+            c->proximo = buscarDiaOcupado(c, ordinal + 1);
+    }
+}
+
+// El lote cambio de direccion (copia por version o reubicacion del nodo)
+void calendarioReemplazar(NodoAVL* anterior, NodoAVL* nuevo) {
+    Calendario* c = calendarioActivo;
+    if (c == NULL || !fechaValida(nuevo->fecha))
+        return;
+    int ranura = ranuraDia(ordinalDia(nuevo->fecha));
+    if (c->dias[ranura] == anterior)
+        c->dias[ranura] = nuevo;
+}
+
 // ================= FUNCIONES DE LA COLA FIFO =================
 // Crear un nuevo pedido
 Pedido* crearPedido(const char* destino, int cantidad) {
-    Pedido* nuevo = (Pedido*)malloc(sizeof(Pedido));
+    Pedido* nuevo = (Pedido*)reservarNodo(&memoriaPedidos, sizeof(Pedido));
+    EST_SUMAR(estadisticas.pedidosCreados, 1);
     strcpy(nuevo->destino, destino);
     nuevo->cantidad = cantidad;
     nuevo->siguiente = NULL;
+    nuevo->bloque = NULL;
     return nuevo;
 }
 
+void liberarPedido(Pedido* pedido) {
+    liberarNodo(&memoriaPedidos, pedido, pedido->bloque, sizeof(Pedido));
+    EST_SUMAR(estadisticas.pedidosLiberados, 1);
+}
+
 // Agregar pedido al final de la cola
-void encolar(Pedido** cabeza, const char* destino, int cantidad) {
+void encolar(Pedido** cabeza, Pedido** ultimo, const char* destino, int cantidad) {
     Pedido* nuevo = crearPedido(destino, cantidad);
     if (*cabeza == NULL) {
         *cabeza = nuevo;
     } else {
-        Pedido* temp = *cabeza;
-        while (temp->siguiente != NULL) {
-            temp = temp->siguiente;
-        }
-        temp->siguiente = nuevo;
+        (*ultimo)->siguiente = nuevo;
     }
+    *ultimo = nuevo;
+}
+
+// Registrar un pedido en el lote: encolarlo y descontar su cantidad del stock
+void registrarPedido(NodoAVL* nodo, const char* destino, int cantidad) {
+    encolar(&(nodo->cabeza), &(nodo->ultimo), destino, cantidad);
+    nodo->stock -= cantidad;
+    anotarCambio(&cambiosLotes, nodo->fecha, CAMBIO_MODIFICACION);
+}
+
+// Buscar un pedido en la cola (el primero con ese destino y cantidad)
+Pedido* buscarPedido(Pedido* cabeza, const char* destino, int cantidad) {
+    while (cabeza != NULL && (cabeza->cantidad != cantidad || strcmp(cabeza->destino, destino) != 0))
+        cabeza = cabeza->siguiente;
+    return cabeza;
 }
 
 // Eliminar un pedido específico de la cola//
 int cancelarPedido(Pedido** cabeza, const char* destino, int cantidad, NodoAVL* nodo) {
+    EST_INICIO(inicio);
     Pedido* actual = *cabeza;
     Pedido* anterior = NULL;
 
@@ -57,13 +257,18 @@ int cancelarPedido(Pedido** cabeza, const char* destino, int cantidad, NodoAVL*
             } else {
                 anterior->siguiente = actual->siguiente;
             }
+            if (nodo->ultimo == actual)
+                nodo->ultimo = anterior;
             nodo->stock += actual->cantidad; // Restaurar stock
-            free(actual);
+            liberarPedido(actual);
+            anotarCambio(&cambiosLotes, nodo->fecha, CAMBIO_MODIFICACION);
+            EST_FIN(estadisticas.cancelacion, inicio);
             return 1; // Eliminado
         }
         anterior = actual;
         actual = actual->siguiente;
     }
+    EST_FIN(estadisticas.cancelacion, inicio);
     return 0; // No encontrado
 }
 
@@ -73,7 +278,7 @@ void liberarCola(Pedido* cabeza) {
     while (cabeza != NULL) {
         temp = cabeza;
         cabeza = cabeza->siguiente;
-        free(temp);
+        liberarPedido(temp);
     }
 }
 
@@ -89,13 +294,6 @@ int contarPedidos(Pedido* cabeza) {
 }
 
 // FUNCIONES DEL ÁRBOL AVL
-// Función auxiliar para obtener la altura
-int altura(NodoAVL* nodo) {
-    if (nodo == NULL)
-        return 0;
-    return nodo->altura;
-}
-
 // Función para obtener el máximo de dos enteros//
 int maximo(int a, int b) {
     return (a > b) ? a : b;
@@ -103,583 +301,2207 @@ int maximo(int a, int b) {
 
 // Crear un nuevo nodo AVL
 NodoAVL* crearNodoAVL(int fecha, const char* producto, int stock) {
-    NodoAVL* nodo = (NodoAVL*)malloc(sizeof(NodoAVL));
+    NodoAVL* nodo = (NodoAVL*)reservarNodo(&memoriaLotes, sizeof(NodoAVL));
+    EST_SUMAR(estadisticas.nodosCreados, 1);
     nodo->fecha = fecha;
     strcpy(nodo->producto, producto);
     nodo->stock = stock;
     nodo->cabeza = NULL;
+    nodo->ultimo = NULL;
     nodo->altura = 1;
+    atomic_init(&nodo->refs, 1);
+    nodo->bloque = NULL;
     nodo->izquierda = NULL;
     nodo->derecha = NULL;
     return nodo;
 }
 
-// Rotación simple a la derecha//
-NodoAVL* rotarDerecha(NodoAVL* y) {
-    NodoAVL* x = y->izquierda;
-    NodoAVL* T2 = x->derecha;
+// ================= VERSIONES (COPIA EN ESCRITURA) =================
+// Un reporte abre una version sumando una referencia a la raiz. Mientras
+// exista, los escritores copian cada nodo compartido (refs > 1) antes de
+// modificarlo, de modo que la version queda inmutable. Sin versiones
+// abiertas todos los nodos tienen refs == 1 y se modifican en sitio.
+void liberarAVL(NodoAVL* raiz);
+
+// Copiar una cola de pedidos completa
+Pedido* copiarCola(Pedido* cabeza, Pedido** ultimo) {
+    Pedido* copia = NULL;
+    *ultimo = NULL;
+    for (Pedido* p = cabeza; p != NULL; p = p->siguiente)
+        encolar(&copia, ultimo, p->destino, p->cantidad);
+    return copia;
+}
 
-    x->derecha = y;
-    y->izquierda = T2;
+// Obtener un nodo modificable: si esta compartido se clona y se suelta el original
+NodoAVL* hacerPropio(NodoAVL* nodo) {
+    if (nodo == NULL || atomic_load(&nodo->refs) == 1)
+        return nodo;
+
+    EST_SUMAR(estadisticas.copiasPorVersion, 1);
+    NodoAVL* copia = crearNodoAVL(nodo->fecha, nodo->producto, nodo->stock);
+    copia->altura = nodo->altura;
+    copia->cabeza = copiarCola(nodo->cabeza, &copia->ultimo);
+    copia->izquierda = nodo->izquierda;
+    copia->derecha = nodo->derecha;
+    if (copia->izquierda)
+        atomic_fetch_add(&copia->izquierda->refs, 1);
+    if (copia->derecha)
+        atomic_fetch_add(&copia->derecha->refs, 1);
+
+    calendarioReemplazar(nodo, copia);
+    liberarAVL(nodo);
+    return copia;
+}
 
-    y->altura = maximo(altura(y->izquierda), altura(y->derecha)) + 1;
-    x->altura = maximo(altura(x->izquierda), altura(x->derecha)) + 1;
+// Abrir una version inmutable del inventario para lectura
+NodoAVL* abrirVersion(NodoAVL* raiz) {
+    if (raiz != NULL)
+        atomic_fetch_add(&raiz->refs, 1);
+    return raiz;
+}
 
-    return x;
+// Cerrar una version; los nodos que solo ella usaba se liberan aqui
+void cerrarVersion(NodoAVL* version) {
+    liberarAVL(version);
 }
 
-// Rotación simple a la izquierda
-NodoAVL* rotarIzquierda(NodoAVL* x) {
-    NodoAVL* y = x->derecha;
-    NodoAVL* T2 = y->izquierda;
+// Datos de un lote nuevo mientras la insercion busca su lugar
+typedef struct DatosLote {
+    const char* producto;
+    int stock;
+} DatosLote;
 
-    y->izquierda = x;
-    x->derecha = T2;
+// Crear el nodo de un lote insertado y anotarlo en el calendario
+NodoAVL* crearLoteIndexado(int fecha, const DatosLote* datos) {
+    NodoAVL* nodo = crearNodoAVL(fecha, datos->producto, datos->stock);
+    calendarioAgregar(nodo);
+    anotarCambio(&cambiosLotes, fecha, CAMBIO_ALTA);
+    return nodo;
+}
 
-    x->altura = maximo(altura(x->izquierda), altura(x->derecha)) + 1;
-    y->altura = maximo(altura(y->izquierda), altura(y->derecha)) + 1;
+// Liberar un nodo que sale del arbol junto con su cola de pedidos
+void liberarLote(NodoAVL* nodo) {
+    liberarCola(nodo->cabeza);
+    liberarNodo(&memoriaLotes, nodo, nodo->bloque, sizeof(NodoAVL));
+    EST_SUMAR(estadisticas.nodosLiberados, 1);
+}
 
-    return y;
+// Liberar un lote eliminado del arbol vivo (no los que solo retenia una
+// version): sale del calendario en O(1), sin otro descenso por la fecha
+void liberarLoteEliminado(NodoAVL* nodo) {
+    calendarioQuitar(nodo->fecha);
+    anotarCambio(&cambiosLotes, nodo->fecha, CAMBIO_BAJA);
+    liberarLote(nodo);
 }
 
-// Obtener el factor de balance//
-int balanceFactor(NodoAVL* nodo) {
-    if (nodo == NULL)
-        return 0;
-    return altura(nodo->izquierda) - altura(nodo->derecha);
+// Arbol de lotes por fecha: funciones lotes* del nucleo comun. Cada nodo
+// del camino se hace propio antes de tocarlo (copia en escritura).
+#define ARBOL_PREFIJO lotes
+#define ARBOL_NODO NodoAVL
+#define ARBOL_CLAVE_TIPO int
+#define ARBOL_CLAVE(n) ((n)->fecha)
+#define ARBOL_IZQ izquierda
+#define ARBOL_DER derecha
+#define ARBOL_ALTURA altura
+#define ARBOL_PROPIO(n) hacerPropio(n)
+#define ARBOL_CREAR(clave, datos) crearLoteIndexado((clave), (const DatosLote*)(datos))
+#define ARBOL_LIBERAR(n) liberarLoteEliminado(n)
+#define ARBOL_VISITA() EST_SUMAR(estadisticas.nodosVisitados, 1)
+#define ARBOL_AL_BALANCEAR(caso) EST_SUMAR(estadisticas.rotaciones##caso, 1)
+#include "arbol_avl.h"
+
+// Registrar la altura del arbol cada cierto numero de mutaciones
+void muestrearAltura(NodoAVL* raiz) {
+    if (!ESTADISTICAS_ACTIVAS)
+        return;
+    uint64_t n = __atomic_fetch_add(&estadisticas.mutaciones, 1, __ATOMIC_RELAXED);
+    if (n % MUTACIONES_POR_MUESTRA == 0)
+        estadisticas.alturas[(n / MUTACIONES_POR_MUESTRA) % MUESTRAS_ALTURA] = lotesAltura(raiz);
 }
 
-// Insertar en el árbol AVL
+// Insertar en el árbol AVL (una fecha duplicada no se inserta)
 NodoAVL* insertarAVL(NodoAVL* nodo, int fecha, const char* producto, int stock) {
-    if (nodo == NULL)
-        return crearNodoAVL(fecha, producto, stock);
+    DatosLote datos = {producto, stock};
+    NodoAVL* existente;
+    EST_INICIO(inicio);
+    EST_SUMAR(estadisticas.descensos, 1);
+    nodo = lotesInsertar(nodo, fecha, &datos, &existente);
+    EST_FIN(estadisticas.insertar, inicio);
+    muestrearAltura(nodo);
+    return nodo;
+}
 
-    if (fecha < nodo->fecha)
-        nodo->izquierda = insertarAVL(nodo->izquierda, fecha, producto, stock);
-    else if (fecha > nodo->fecha)
-        nodo->derecha = insertarAVL(nodo->derecha, fecha, producto, stock);
-    else
-        return nodo; // Fecha duplicada (no permitida según requerimiento)
+// Obtener el minimo listo para modificar, copiando el camino si esta compartido
+NodoAVL* minimoParaModificar(NodoAVL** raiz) {
+    return lotesMinimoPropio(raiz);
+}
 
-    nodo->altura = 1 + maximo(altura(nodo->izquierda), altura(nodo->derecha));
+// Buscar un nodo por fecha para modificarlo, copiando el camino si esta compartido
+NodoAVL* buscarParaModificar(NodoAVL** raiz, int fecha) {
+    EST_SUMAR(estadisticas.descensos, 1);
+    return lotesBuscarPropio(raiz, fecha);
+}
 
-    int balance = balanceFactor(nodo);
+// Eliminar un nodo del árbol AVL
+NodoAVL* eliminarNodoAVL(NodoAVL* raiz, int fecha) {
+    EST_INICIO(inicio);
+    EST_SUMAR(estadisticas.descensos, 1);
+    raiz = lotesEliminar(raiz, fecha);
+    EST_FIN(estadisticas.eliminar, inicio);
+    muestrearAltura(raiz);
+    return raiz;
+}
 
-    // Casos de desbalance
-    if (balance > 1 && fecha < nodo->izquierda->fecha)
-        return rotarDerecha(nodo);
+// Buscar un nodo por fecha
+NodoAVL* buscarNodo(NodoAVL* raiz, int fecha) {
+    EST_INICIO(inicio);
+    EST_SUMAR(estadisticas.descensos, 1);
+    NodoAVL* nodo = lotesBuscar(raiz, fecha);
+    EST_FIN(estadisticas.buscar, inicio);
+    return nodo;
+}
 
-    if (balance < -1 && fecha > nodo->derecha->fecha)
-        return rotarIzquierda(nodo);
+// Recorrido In-Order (más próximo a más lejano)
+void inOrder(NodoAVL* raiz) {
+    if (raiz != NULL) {
+        inOrder(raiz->izquierda);
+        printf("Fecha: %d | Producto: %s | Stock: %d | Pedidos en cola: %d\n",
+               raiz->fecha, raiz->producto, raiz->stock, contarPedidos(raiz->cabeza));
+        inOrder(raiz->derecha);
+    }
+}
 
-    if (balance > 1 && fecha > nodo->izquierda->fecha) {
-        nodo->izquierda = rotarIzquierda(nodo->izquierda);
-        return rotarDerecha(nodo);
+// Reporte de cambios desde la version de un reporte anterior, en orden de
+// fecha: + lote nuevo, - lote eliminado, * stock o cola modificados. Devuelve
+// cuantos hubo, o -1 si esa version ya no esta en el registro.
+long reporteCambios(FILE* salida, NodoAVL* raiz, uint64_t desde, uint64_t* hasta) {
+    CambioNeto* cambios;
+    long n = cambiosDesde(&cambiosLotes, desde, &cambios, hasta);
+    for (long i = 0; i < n; i++) {
+        NodoAVL* nodo = cambios[i].tipo == CAMBIO_BAJA ? NULL : buscarNodo(raiz, cambios[i].clave);
+        if (nodo == NULL)
+            fprintf(salida, "- Fecha: %d\n", cambios[i].clave);
+        else
+            fprintf(salida, "%c Fecha: %d | Producto: %s | Stock: %d | Pedidos en cola: %d\n",
+                    cambios[i].tipo == CAMBIO_ALTA ? '+' : '*', nodo->fecha, nodo->producto,
+                    nodo->stock, contarPedidos(nodo->cabeza));
     }
+    free(cambios);
+    return n;
+}
+
+void exportarLote(Exportador* e, const NodoAVL* lote) {
+    campoFecha(e, lote->fecha, 10);
+    campoTexto(e, lote->producto, 30);
+    campoEntero(e, lote->stock, 10);
+    campoEntero(e, contarPedidos(lote->cabeza), 8);
+    finRegistro(e);
+}
 
-    if (balance < -1 && fecha < nodo->derecha->fecha) {
-        nodo->derecha = rotarDerecha(nodo->derecha);
-        return rotarIzquierda(nodo);
+// Escribir los lotes en orden de vencimiento, directo desde el recorrido
+void exportarLotes(Exportador* e, NodoAVL* raiz) {
+    if (raiz != NULL) {
+        exportarLotes(e, raiz->izquierda);
+        exportarLote(e, raiz);
+        exportarLotes(e, raiz->derecha);
     }
+}
 
-    return nodo;
+void visitarLoteExportado(const void* nodo, ParcialRecorrido* parcial, void* contexto) {
+    (void)contexto;
+    exportarLote(&parcial->salida, (const NodoAVL*)nodo);
 }
 
-// Encontrar el nodo con la fecha mínima (más próxima a vencer)
-NodoAVL* encontrarMinimo(NodoAVL* nodo) {
-    NodoAVL* actual = nodo;
-    while (actual->izquierda != NULL)
-        actual = actual->izquierda;
-    return actual;
+// Exportar el inventario de una version; devuelve los lotes escritos o -1.
+// Con un pool de varios hilos, las partes del arbol se escriben en paralelo
+// y se anexan en orden; con uno solo se escribe directo desde el recorrido.
+long exportarInventario(NodoAVL* version, const char* ruta, int formato, PoolRecorrido* pool) {
+    static const char* nombres[] = {"fecha", "producto", "stock", "pedidos"};
+    static const int tipos[] = {CAMPO_FECHA, CAMPO_TEXTO, CAMPO_ENTERO, CAMPO_ENTERO};
+    static const int anchos[] = {10, 30, 10, 8};
+    Exportador e;
+    if (!abrirExportador(&e, ruta, formato)) {
+        cerrarExportador(&e);
+        return -1;
+    }
+    encabezadoExportador(&e, 4, nombres, tipos, anchos);
+    if (pool != NULL && pool->numHilos > 0) {
+        RecorridoParalelo r = {offsetof(NodoAVL, izquierda), offsetof(NodoAVL, derecha),
+                               visitarLoteExportado, NULL, formato};
+        ParcialRecorrido total;
+        iniciarParcial(&total);
+        recorrerEnParalelo(pool, &r, version, &total, &e);
+        liberarParcial(&total);
+    } else {
+        exportarLotes(&e, version);
+    }
+    long registros = e.registros;
+    return cerrarExportador(&e) ? registros : -1;
 }
 
-// Eliminar un nodo del árbol AVL
-NodoAVL* eliminarNodoAVL(NodoAVL* raiz, int fecha) {
-    if (raiz == NULL)
-        return raiz;
-
-    if (fecha < raiz->fecha)
-        raiz->izquierda = eliminarNodoAVL(raiz->izquierda, fecha);
-    else if (fecha > raiz->fecha)
-        raiz->derecha = eliminarNodoAVL(raiz->derecha, fecha);
-    else {
-        // Nodo encontrado: liberar cola y luego el nodo
-        liberarCola(raiz->cabeza);
-
-        if (raiz->izquierda == NULL || raiz->derecha == NULL) {
-            NodoAVL* temp = raiz->izquierda ? raiz->izquierda : raiz->derecha;
-            free(raiz);
-            return temp;
-        } else {
-            NodoAVL* temp = encontrarMinimo(raiz->derecha);
-            raiz->fecha = temp->fecha;
-            raiz->stock = temp->stock;
-            strcpy(raiz->producto, temp->producto);
-            raiz->cabeza = temp->cabeza;
-            temp->cabeza = NULL; // Evitar que se libere dos veces
-            raiz->derecha = eliminarNodoAVL(raiz->derecha, temp->fecha);
-        }
+// Soltar una referencia al árbol AVL; se liberan los nodos que no comparte otra version
+void liberarAVL(NodoAVL* raiz) {
+    if (raiz != NULL && atomic_fetch_sub(&raiz->refs, 1) == 1) {
+        liberarAVL(raiz->izquierda);
+        liberarAVL(raiz->derecha);
+        liberarLote(raiz);
     }
+}
 
-    if (raiz == NULL)
-        return raiz;
+// ================= MEMORIA Y COMPACTACION =================
+// Tras semanas de recepciones, despachos y bajas, los lotes y pedidos quedan
+// dispersos por el heap. La compactacion los copia a bloques contiguos en
+// orden de fecha (cada lote con su cola en orden FIFO) y libera los nodos
+// viejos. Avanza por tramos para no detener el servicio: cada paso reubica
+// a lo sumo un numero fijo de lotes desde la fecha donde quedo el anterior.
+// El camino que toca se hace propio como en cualquier escritura, asi que
+// las versiones abiertas conservan sus nodos.
+#define PASO_COMPACTACION 4096
+#define ROTACION_MINIMA 65536   // Nodos liberados antes de compactar solo
+
+typedef struct Compactacion {
+    int activa;
+    int desde;                  // Primera fecha que falta reubicar
+    long lotes, pedidos;        // Reubicados en la pasada
+    int pasos;
+    int64_t liberadosAlTerminar;  // Rotacion del heap al cerrar la ultima pasada
+} Compactacion;
+
+// Estado de un paso: bloques de destino y ranuras ya ocupadas
+typedef struct TramoCompactacion {
+    int desde;
+    long restantes;             // Lotes que aun caben en el paso
+    BloqueCompacto* bloqueLotes;
+    BloqueCompacto* bloquePedidos;
+    long siguienteLote, siguientePedido;
+    int ultima;                 // Ultima fecha reubicada
+} TramoCompactacion;
+
+void iniciarCompactacion(Compactacion* c) {
+    c->activa = 1;
+    c->desde = INT_MIN;
+    c->lotes = 0;
+    c->pedidos = 0;
+    c->pasos = 0;
+}
 
-    raiz->altura = 1 + maximo(altura(raiz->izquierda), altura(raiz->derecha));
+// Cerrar la pasada y devolver al sistema las paginas que dejaron libres los nodos viejos
+void terminarCompactacion(Compactacion* c) {
+    c->activa = 0;
+    devolverMemoriaLibre();
+    c->liberadosAlTerminar = leerCuenta(&memoriaLotes.liberados) + leerCuenta(&memoriaPedidos.liberados);
+}
 
-    int balance = balanceFactor(raiz);
+// Hay que compactar cuando se libero al menos tanta memoria como la que sigue viva
+int requiereCompactacion(const Compactacion* c) {
+    int64_t rotacion = leerCuenta(&memoriaLotes.liberados) + leerCuenta(&memoriaPedidos.liberados) -
+                       c->liberadosAlTerminar;
+    int64_t vivos = leerCuenta(&memoriaLotes.vivos) + leerCuenta(&memoriaPedidos.vivos);
+    return rotacion >= ROTACION_MINIMA && rotacion >= vivos;
+}
 
-    // Rebalancear
-    if (balance > 1 && balanceFactor(raiz->izquierda) >= 0)
-        return rotarDerecha(raiz);
+// Contar lotes y pedidos del proximo tramo (hasta 'limite' lotes desde 'desde')
+void medirTramo(NodoAVL* nodo, int desde, long limite, long* lotes, long* pedidos) {
+    if (nodo == NULL || *lotes >= limite)
+        return;
+    if (nodo->fecha > desde)
+        medirTramo(nodo->izquierda, desde, limite, lotes, pedidos);
+    if (nodo->fecha >= desde && *lotes < limite) {
+        (*lotes)++;
+        *pedidos += contarPedidos(nodo->cabeza);
+    }
+    medirTramo(nodo->derecha, desde, limite, lotes, pedidos);
+}
 
-    if (balance > 1 && balanceFactor(raiz->izquierda) < 0) {
-        raiz->izquierda = rotarIzquierda(raiz->izquierda);
-        return rotarDerecha(raiz);
+// Llevar la cola de un lote a las ranuras siguientes del bloque de pedidos
+void reubicarCola(NodoAVL* nodo, TramoCompactacion* t) {
+    Pedido* anterior = NULL;
+    Pedido* p = nodo->cabeza;
+    nodo->cabeza = NULL;
+    while (p != NULL) {
+        Pedido* nuevo = (Pedido*)ranuraBloque(t->bloquePedidos, sizeof(Pedido), t->siguientePedido++);
+        Pedido* siguiente = p->siguiente;
+        *nuevo = *p;
+        nuevo->siguiente = NULL;
+        nuevo->bloque = t->bloquePedidos;
+        if (anterior == NULL)
+            nodo->cabeza = nuevo;
+        else
+            anterior->siguiente = nuevo;
+        anterior = nuevo;
+        EST_SUMAR(estadisticas.pedidosCreados, 1);
+        liberarPedido(p);
+        p = siguiente;
     }
+    nodo->ultimo = anterior;
+}
 
-    if (balance < -1 && balanceFactor(raiz->derecha) <= 0)
-        return rotarIzquierda(raiz);
+// Reubicar en orden los lotes del tramo, reenlazando desde *enlace
+void reubicarTramo(NodoAVL** enlace, TramoCompactacion* t) {
+    if (*enlace == NULL || t->restantes == 0)
+        return;
+    NodoAVL* nodo = *enlace = hacerPropio(*enlace);
+    if (nodo->fecha > t->desde)
+        reubicarTramo(&nodo->izquierda, t);
+    if (nodo->fecha >= t->desde && t->restantes > 0) {
+        NodoAVL* nuevo = (NodoAVL*)ranuraBloque(t->bloqueLotes, sizeof(NodoAVL), t->siguienteLote++);
+        memcpy(nuevo, nodo, sizeof(NodoAVL));
+        atomic_init(&nuevo->refs, 1);
+        nuevo->bloque = t->bloqueLotes;
+        reubicarCola(nuevo, t);
+        calendarioReemplazar(nodo, nuevo);
+        // La cola ya paso al nodo nuevo; el viejo se reemplaza, no es una baja
+        nodo->cabeza = NULL;
+        EST_SUMAR(estadisticas.nodosCreados, 1);
+        liberarLote(nodo);
+        *enlace = nodo = nuevo;
+        t->restantes--;
+        t->ultima = nodo->fecha;
+    }
+    reubicarTramo(&nodo->derecha, t);
+}
 
-    if (balance < -1 && balanceFactor(raiz->derecha) > 0) {
-        raiz->derecha = rotarDerecha(raiz->derecha);
-        return rotarIzquierda(raiz);
+// Un paso de compactacion; devuelve 1 mientras queden lotes por reubicar
+int compactarPaso(NodoAVL** raiz, Compactacion* c, long limite) {
+    long lotes = 0, pedidos = 0;
+    if (c->activa)
+        medirTramo(*raiz, c->desde, limite, &lotes, &pedidos);
+    if (lotes == 0) {
+        terminarCompactacion(c);
+        return 0;
+    }
+    TramoCompactacion t = {c->desde, lotes, NULL, NULL, 0, 0, c->desde};
+    t.bloqueLotes = reservarBloque(&memoriaLotes, sizeof(NodoAVL), lotes);
+    if (pedidos > 0)
+        t.bloquePedidos = reservarBloque(&memoriaPedidos, sizeof(Pedido), pedidos);
+    if (t.bloqueLotes == NULL || (pedidos > 0 && t.bloquePedidos == NULL)) {
+        printf("Error: Sin memoria para compactar.\n");
+        if (t.bloqueLotes != NULL)
+            soltarBloque(t.bloqueLotes);
+        if (t.bloquePedidos != NULL)
+            soltarBloque(t.bloquePedidos);
+        c->activa = 0;
+        return 0;
     }
+    reubicarTramo(raiz, &t);
+    c->lotes += lotes;
+    c->pedidos += pedidos;
+    c->pasos++;
+    if (lotes < limite || t.ultima == INT_MAX) {
+        terminarCompactacion(c);
+        return 0;
+    }
+    c->desde = t.ultima + 1;
+    return 1;
+}
 
-    return raiz;
+// Volcar la memoria de cada estructura
+void imprimirMemoria(FILE* salida) {
+    int64_t lotes = leerCuenta(&memoriaLotes.vivos), pedidos = leerCuenta(&memoriaPedidos.vivos);
+    fprintf(salida, "\n=== MEMORIA ===\n");
+    imprimirCuentaMemoria(salida, "lotes", &memoriaLotes);
+    imprimirCuentaMemoria(salida, "pedidos", &memoriaPedidos);
+    fprintf(salida, "Pedidos por lote: %.2f | Nodos liberados desde el arranque: %lld\n",
+            lotes ? (double)pedidos / lotes : 0.0,
+            (long long)(leerCuenta(&memoriaLotes.liberados) + leerCuenta(&memoriaPedidos.liberados)));
 }
 
-// Buscar un nodo por fecha
-NodoAVL* buscarNodo(NodoAVL* raiz, int fecha) {
-    if (raiz == NULL || raiz->fecha == fecha)
-        return raiz;
+// ================= BITACORA DE OPERACIONES (WAL) =================
+// Toda mutacion se anexa a un archivo binario antes de aplicarse en memoria;
+// si no se pudo anotar, no se aplica. Los registros se acumulan en un buffer
+// y se confirman en lote con un solo fdatasync (group commit): al llenarse el
+// lote o al vencer su espera lo escribe un hilo confirmador, sin detener a
+// quien sigue anotando (hay dos buffers). Una operacion es durable solo
+// cuando confirmarBitacora devuelve 1; antes de eso no se le debe reportar
+// como hecha a nadie. Un error de escritura o de fdatasync deja la bitacora
+// en falla: no se anota ni confirma nada mas, para que memoria y disco no se
+// separen. Al arrancar se carga el ultimo snapshot y se reaplican los
+// registros con numero de secuencia (LSN) posterior.
+#define ARCHIVO_BITACORA "logistico.wal"
+#define ARCHIVO_SNAPSHOT "logistico.snap"
+#define MAGIA_SNAPSHOT "LOGSNAP1"
+#define BITACORA_BUFFER (64 * 1024)
+#define BITACORA_LOTE 128              // Registros maximos por confirmacion
+#define BITACORA_ESPERA_NS 2000000L    // Espera maxima de un lote abierto (2 ms)
+#define SNAPSHOT_CADA 100000           // Registros entre snapshots automaticos
+#define REGISTRO_CABECERA 18           // lsn(8) tipo(1) len(1) fecha(4) cantidad(4)
+
+enum { OP_INSERTAR = 1, OP_ENCOLAR, OP_ELIMINAR, OP_CANCELAR };
+
+typedef struct Bitacora {
+    int fd;                         // -1 si la bitacora esta desactivada
+    uint64_t lsn;                   // Ultimo numero de secuencia asignado
+    unsigned char buffers[2][BITACORA_BUFFER];
+    unsigned char* buffer;          // El que se esta llenando
+    size_t usados;
+    int pendientes;                 // Registros en el lote abierto
+    struct timespec inicioLote;
+    long registrosDesdeSnapshot;
+    long confirmaciones;            // fdatasync realizados
+    int escribiendo;                // Hay un lote en write/fdatasync fuera del candado
+    int fallo;                      // Una escritura fallo: la bitacora ya no acepta nada
+    int detener;
+    int conConfirmador;
+    pthread_t confirmador;
+    pthread_mutex_t candado;        // Los muelles registran en paralelo
+    pthread_cond_t cambio;          // Lote abierto, lote escrito o fin
+} Bitacora;
+
+// Suma de verificacion FNV-1a para detectar registros truncados
+uint32_t sumaRegistro(const unsigned char* datos, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= datos[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
-    if (fecha < raiz->fecha)
-        return buscarNodo(raiz->izquierda, fecha);
+// Escribir el lote abierto y forzarlo a disco con un solo fdatasync. El
+// llamador tiene el candado de la bitacora; se suelta durante la escritura
+// y los registros nuevos van al otro buffer. Al volver, todo lo anotado
+// antes de la llamada esta en disco (o la bitacora quedo en falla).
+int escribirLoteBitacora(Bitacora* b) {
+    while (b->escribiendo)
+        pthread_cond_wait(&b->cambio, &b->candado);
+    if (b->fallo)
+        return 0;
+    if (b->usados == 0)
+        return 1;
+
+    unsigned char* lote = b->buffer;
+    size_t largo = b->usados;
+    b->buffer = lote == b->buffers[0] ? b->buffers[1] : b->buffers[0];
+    b->usados = 0;
+    b->pendientes = 0;
+    b->escribiendo = 1;
+    pthread_mutex_unlock(&b->candado);
+
+    int ok = 1;
+    size_t escrito = 0;
+    while (ok && escrito < largo) {
+        ssize_t n = write(b->fd, lote + escrito, largo - escrito);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            perror("Error escribiendo bitacora");
+            ok = 0;
+        } else {
+            escrito += (size_t)n;
+        }
+    }
+    if (ok && fdatasync(b->fd) != 0) {
+        perror("Error sincronizando bitacora");
+        ok = 0;
+    }
 
-    return buscarNodo(raiz->derecha, fecha);
+    pthread_mutex_lock(&b->candado);
+    b->escribiendo = 0;
+    if (ok)
+        b->confirmaciones++;
+    else
+        b->fallo = 1;
+    pthread_cond_broadcast(&b->cambio);
+    return ok;
 }
 
-// Recorrido In-Order (más próximo a más lejano)
-void inOrder(NodoAVL* raiz) {
-    if (raiz != NULL) {
-        inOrder(raiz->izquierda);
-        printf("Fecha: %d | Producto: %s | Stock: %d | Pedidos en cola: %d\n",
-               raiz->fecha, raiz->producto, raiz->stock, contarPedidos(raiz->cabeza));
-        inOrder(raiz->derecha);
+// Hilo confirmador: escribe el lote abierto cuando se llena o cuando vence
+// su espera, aunque no llegue ninguna operacion mas
+void* confirmarEnSegundoPlano(void* arg) {
+    Bitacora* b = (Bitacora*)arg;
+    pthread_mutex_lock(&b->candado);
+    while (!b->detener && !b->fallo) {
+        if (b->pendientes == 0 || b->escribiendo) {
+            pthread_cond_wait(&b->cambio, &b->candado);
+            continue;
+        }
+        struct timespec limite = b->inicioLote, ahora;
+        limite.tv_nsec += BITACORA_ESPERA_NS;
+        if (limite.tv_nsec >= 1000000000L) {
+            limite.tv_sec++;
+            limite.tv_nsec -= 1000000000L;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ahora);
+        int vencido = ahora.tv_sec > limite.tv_sec ||
+                      (ahora.tv_sec == limite.tv_sec && ahora.tv_nsec >= limite.tv_nsec);
+        if (b->pendientes >= BITACORA_LOTE || vencido)
+            escribirLoteBitacora(b);
+        else
+            pthread_cond_timedwait(&b->cambio, &b->candado, &limite);
     }
+    pthread_mutex_unlock(&b->candado);
+    return NULL;
 }
 
-// Liberar todo el árbol AVL
-void liberarAVL(NodoAVL* raiz) {
-    if (raiz != NULL) {
-        liberarAVL(raiz->izquierda);
-        liberarAVL(raiz->derecha);
-        liberarCola(raiz->cabeza);
-        free(raiz);
+void iniciarSincronizacion(Bitacora* b) {
+    pthread_condattr_t atributos;
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_mutex_init(&b->candado, NULL);
+    pthread_cond_init(&b->cambio, &atributos);
+    pthread_condattr_destroy(&atributos);
+    b->buffer = b->buffers[0];
+    b->usados = 0;
+    b->pendientes = 0;
+    b->registrosDesdeSnapshot = 0;
+    b->confirmaciones = 0;
+    b->escribiendo = 0;
+    b->fallo = 0;
+    b->detener = 0;
+    b->conConfirmador = 0;
+}
+
+// Confirmar el lote abierto
+int confirmarBitacora(Bitacora* b) {
+    if (b->fd < 0)
+        return 1;
+    pthread_mutex_lock(&b->candado);
+    int ok = escribirLoteBitacora(b);
+    pthread_mutex_unlock(&b->candado);
+    return ok;
+}
+
+#define BITACORA_LLENA (-1)
+
+// Anexar una operacion al lote abierto; el confirmador la escribe al
+// llenarse el lote o al vencer la espera. Devuelve 1 si quedo anotada y 0 si
+// no (bitacora en falla): la operacion no debe aplicarse. Con los dos
+// buffers llenos espera al disco, o devuelve BITACORA_LLENA sin anotar si
+// no puede esperar (el llamador tiene candados del arbol).
+int anotarEnBitacora(Bitacora* b, int tipo, int fecha, int cantidad, const char* texto, int puedeEsperar) {
+    if (b->fd < 0)
+        return 1;
+
+    size_t largo = texto ? strlen(texto) : 0;
+    if (largo > 49)
+        largo = 49;
+    size_t total = REGISTRO_CABECERA + largo + 4;
+
+    pthread_mutex_lock(&b->candado);
+    if (b->usados + total > BITACORA_BUFFER && !b->fallo && !puedeEsperar) {
+        pthread_cond_broadcast(&b->cambio);
+        pthread_mutex_unlock(&b->candado);
+        return BITACORA_LLENA;
+    }
+    if (b->fallo || (b->usados + total > BITACORA_BUFFER && !escribirLoteBitacora(b))) {
+        pthread_mutex_unlock(&b->candado);
+        return 0;
     }
+    if (b->pendientes == 0)
+        clock_gettime(CLOCK_MONOTONIC, &b->inicioLote);
+
+    unsigned char* p = b->buffer + b->usados;
+    uint64_t lsn = ++b->lsn;
+    int32_t f = fecha, c = cantidad;
+    memcpy(p, &lsn, 8);
+    p[8] = (unsigned char)tipo;
+    p[9] = (unsigned char)largo;
+    memcpy(p + 10, &f, 4);
+    memcpy(p + 14, &c, 4);
+    if (largo > 0)
+        memcpy(p + REGISTRO_CABECERA, texto, largo);
+    uint32_t suma = sumaRegistro(p, REGISTRO_CABECERA + largo);
+    memcpy(p + REGISTRO_CABECERA + largo, &suma, 4);
+
+    b->usados += total;
+    b->pendientes++;
+    b->registrosDesdeSnapshot++;
+
+    // El confirmador toma la espera del lote nuevo, o el lote lleno
+    if (b->pendientes == 1 || b->pendientes == BITACORA_LOTE)
+        pthread_cond_broadcast(&b->cambio);
+    pthread_mutex_unlock(&b->candado);
+    return 1;
 }
 
-// ================= MENÚ PRINCIPAL =================
-void mostrarMenu() {
-    printf("\n=== SISTEMA LOGISTICO PUERTO BUENAVENTURA ===\n");
-    printf("1. Recepcion de Mercancia (Insertar en AVL)\n");
-    printf("2. Registrar Pedido de Despacho (Encolar en FIFO)\n");
-    printf("3. Cancelacion de Producto (Eliminar nodo AVL)\n");
-    printf("4. Cancelar Pedido Especifico\n");
-    printf("5. Reporte de Estado (Recorrido In-Order)\n");
-    printf("6. Salir\n");
-    printf("Seleccione una opcion: ");
+int registrarEnBitacora(Bitacora* b, int tipo, int fecha, int cantidad, const char* texto) {
+    return anotarEnBitacora(b, tipo, fecha, cantidad, texto, 1);
 }
 
-int main() {
-    NodoAVL* raiz = NULL;
-    int opcion, fecha, stock, cantidad;
-    char producto[50], destino[50];
+// Aplicar una operacion sobre el arbol sin volver a registrarla
+void aplicarOperacion(NodoAVL** raiz, int tipo, int fecha, int cantidad, const char* texto) {
+    NodoAVL* nodo;
+    switch (tipo) {
+        case OP_INSERTAR:
+            if (buscarNodo(*raiz, fecha) == NULL)
+                *raiz = insertarAVL(*raiz, fecha, texto, cantidad);
+            break;
+        case OP_ENCOLAR:
+            nodo = buscarParaModificar(raiz, fecha);
+            if (nodo != NULL && cantidad <= nodo->stock) {
+                registrarPedido(nodo, texto, cantidad);
+            }
+            break;
+        case OP_ELIMINAR:
+            *raiz = eliminarNodoAVL(*raiz, fecha);
+            break;
+        case OP_CANCELAR:
+            nodo = buscarParaModificar(raiz, fecha);
+            if (nodo != NULL)
+                cancelarPedido(&(nodo->cabeza), texto, cantidad, nodo);
+            break;
+    }
+}
 
-    do {
-        mostrarMenu();
-        scanf("%d", &opcion);
-        getchar(); // Limpiar buffer
+// Escribir un lote y su cola en el snapshot (recorrido in-order)
+void escribirLote(FILE* f, NodoAVL* nodo) {
+    if (nodo == NULL)
+        return;
+    escribirLote(f, nodo->izquierda);
+
+    int32_t fecha = nodo->fecha, stock = nodo->stock;
+    uint8_t largo = (uint8_t)strlen(nodo->producto);
+    uint32_t pedidos = (uint32_t)contarPedidos(nodo->cabeza);
+    fwrite(&fecha, 4, 1, f);
+    fwrite(&stock, 4, 1, f);
+    fwrite(&largo, 1, 1, f);
+    fwrite(nodo->producto, 1, largo, f);
+    fwrite(&pedidos, 4, 1, f);
+    for (Pedido* p = nodo->cabeza; p != NULL; p = p->siguiente) {
+        int32_t cantidad = p->cantidad;
+        uint8_t largoDestino = (uint8_t)strlen(p->destino);
+        fwrite(&cantidad, 4, 1, f);
+        fwrite(&largoDestino, 1, 1, f);
+        fwrite(p->destino, 1, largoDestino, f);
+    }
 
-        switch (opcion) {
-            case 1:
-                printf("Ingrese fecha de vencimiento (AAAAMMDD): ");
-                scanf("%d", &fecha);
-                printf("Ingrese nombre del producto: ");
-                getchar();
-                fgets(producto, 50, stdin);
-                producto[strcspn(producto, "\n")] = 0;
-                printf("Ingrese stock inicial: ");
-                scanf("%d", &stock);
+    escribirLote(f, nodo->derecha);
+}
 
-                if (buscarNodo(raiz, fecha) != NULL) {
-                    printf("Error: Ya existe un producto con esa fecha.\n");
-                } else {
-                    raiz = insertarAVL(raiz, fecha, producto, stock);
-                    printf("Producto registrado exitosamente.\n");
-                }
-                break;
+// Contar lotes del arbol
+int contarLotes(NodoAVL* raiz) {
+    if (raiz == NULL)
+        return 0;
+    return 1 + contarLotes(raiz->izquierda) + contarLotes(raiz->derecha);
+}
 
-            case 2:
-                if (raiz == NULL) {
-                    printf("No hay productos en inventario.\n");
-                    break;
-                }
-                // Buscar la fecha más próxima (mínima)
-                NodoAVL* masProximo = encontrarMinimo(raiz);
-                printf("Producto mas proximo a vencer: %s (Fecha: %d, Stock: %d)\n",
-                       masProximo->producto, masProximo->fecha, masProximo->stock);
+// Forzar a disco las entradas del directorio de trabajo (creaciones y renombres)
+int sincronizarDirectorio(void) {
+    int fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
 
-                printf("Ingrese destino del pedido: ");
-                getchar();
-                fgets(destino, 50, stdin);
-                destino[strcspn(destino, "\n")] = 0;
-                printf("Ingrese cantidad solicitada: ");
-                scanf("%d", &cantidad);
+// Guardar el inventario completo y vaciar la bitacora. El snapshot se
+// escribe en un temporal y se renombra, de modo que nunca queda a medias;
+// la bitacora se trunca solo cuando el renombre ya esta en disco.
+int guardarSnapshot(Bitacora* b, NodoAVL* raiz) {
+    if (b->fd < 0)
+        return 1;
+    if (!confirmarBitacora(b))
+        return 0;
 
-                if (cantidad > masProximo->stock) {
-                    printf("Error: Stock insuficiente.\n");
-                } else {
-                    encolar(&(masProximo->cabeza), destino, cantidad);
-                    masProximo->stock -= cantidad;
-                    printf("Pedido registrado exitosamente.\n");
-                }
-                break;
+    FILE* f = fopen(ARCHIVO_SNAPSHOT ".tmp", "wb");
+    if (f == NULL) {
+        perror("Error creando snapshot");
+        return 0;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    uint64_t lsn = b->lsn;
+    uint32_t lotes = (uint32_t)contarLotes(raiz);
+    fwrite(MAGIA_SNAPSHOT, 1, 8, f);
+    fwrite(&lsn, 8, 1, f);
+    fwrite(&lotes, 4, 1, f);
+    escribirLote(f, raiz);
+
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+        perror("Error escribiendo snapshot");
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    if (rename(ARCHIVO_SNAPSHOT ".tmp", ARCHIVO_SNAPSHOT) != 0) {
+        perror("Error publicando snapshot");
+        return 0;
+    }
+    if (!sincronizarDirectorio()) {
+        perror("Error sincronizando directorio del snapshot");
+        return 0;
+    }
 
-            case 3:
-                printf("Ingrese fecha del producto a eliminar (AAAAMMDD): ");
-                scanf("%d", &fecha);
-                if (buscarNodo(raiz, fecha) == NULL) {
-                    printf("Error: No existe un producto con esa fecha.\n");
-                } else {
-                    raiz = eliminarNodoAVL(raiz, fecha);
-                    printf("Producto y sus pedidos eliminados exitosamente.\n");
-                }
-                break;
+    // Los registros ya incluidos se descartan; si el proceso cae antes de
+    // truncar, el LSN del snapshot evita reaplicarlos.
+    if (ftruncate(b->fd, 0) != 0 || fdatasync(b->fd) != 0) {
+        perror("Error truncando bitacora");
+        return 0;
+    }
+    b->registrosDesdeSnapshot = 0;
+    return 1;
+}
 
-            case 4:
-                printf("Ingrese fecha del producto (AAAAMMDD): ");
-                scanf("%d", &fecha);
-                NodoAVL* nodoCancelar = buscarNodo(raiz, fecha);
-                if (nodoCancelar == NULL) {
-                    printf("Error: No existe un producto con esa fecha.\n");
-                } else {
-                    printf("Ingrese destino del pedido a cancelar: ");
-                    getchar();
-                    fgets(destino, 50, stdin);
-                    destino[strcspn(destino, "\n")] = 0;
-                    printf("Ingrese cantidad del pedido a cancelar: ");
-                    scanf("%d", &cantidad);
+// Construir un AVL perfectamente balanceado desde lotes ya ordenados
+NodoAVL* construirBalanceado(NodoAVL** lotes, int inicio, int fin) {
+    if (inicio > fin)
+        return NULL;
+    int medio = inicio + (fin - inicio) / 2;
+    NodoAVL* nodo = lotes[medio];
+    nodo->izquierda = construirBalanceado(lotes, inicio, medio - 1);
+    nodo->derecha = construirBalanceado(lotes, medio + 1, fin);
+    lotesActualizarAltura(nodo);
+    return nodo;
+}
 
-                    if (cancelarPedido(&(nodoCancelar->cabeza), destino, cantidad, nodoCancelar)) {
-                        printf("Pedido cancelado exitosamente. Stock restaurado.\n");
-                    } else {
-                        printf("Error: No se encontro el pedido especificado.\n");
-                    }
-                }
-                break;
+// Cargar el snapshot; devuelve el LSN que cubre o 0 si no existe
+uint64_t cargarSnapshot(NodoAVL** raiz) {
+    FILE* f = fopen(ARCHIVO_SNAPSHOT, "rb");
+    if (f == NULL)
+        return 0;
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    char magia[8];
+    uint64_t lsn = 0;
+    uint32_t lotes = 0;
+    if (fread(magia, 1, 8, f) != 8 || memcmp(magia, MAGIA_SNAPSHOT, 8) != 0 ||
+        fread(&lsn, 8, 1, f) != 1 || fread(&lotes, 4, 1, f) != 1) {
+        printf("Error: Snapshot invalido, se ignora.\n");
+        fclose(f);
+        return 0;
+    }
 
-            case 5:
-                if (raiz == NULL) {
-                    printf("No hay productos en inventario.\n");
-                } else {
-                    printf("\n=== REPORTE DE INVENTARIO ===\n");
-                    inOrder(raiz);
-                }
+    NodoAVL** ordenados = (NodoAVL**)malloc(sizeof(NodoAVL*) * (lotes ? lotes : 1));
+    uint32_t leidos = 0;
+    for (; leidos < lotes; leidos++) {
+        int32_t fecha, stock;
+        uint8_t largo;
+        uint32_t pedidos;
+        char producto[50] = {0};
+        if (fread(&fecha, 4, 1, f) != 1 || fread(&stock, 4, 1, f) != 1 ||
+            fread(&largo, 1, 1, f) != 1 || largo > 49 ||
+            fread(producto, 1, largo, f) != largo || fread(&pedidos, 4, 1, f) != 1)
+            break;
+
+        NodoAVL* nodo = crearNodoAVL(fecha, producto, stock);
+        for (uint32_t i = 0; i < pedidos; i++) {
+            int32_t cantidad;
+            uint8_t largoDestino;
+            char destino[50] = {0};
+            if (fread(&cantidad, 4, 1, f) != 1 || fread(&largoDestino, 1, 1, f) != 1 ||
+                largoDestino > 49 || fread(destino, 1, largoDestino, f) != largoDestino)
                 break;
+            encolar(&nodo->cabeza, &nodo->ultimo, destino, cantidad);
+        }
+        ordenados[leidos] = nodo;
+    }
+    fclose(f);
 
-            case 6:
-                printf("Saliendo del sistema...\n");
-                break;
+    if (leidos < lotes)
+        printf("Advertencia: Snapshot truncado, se cargaron %u de %u lotes.\n", leidos, lotes);
+    *raiz = construirBalanceado(ordenados, 0, (int)leidos - 1);
+    free(ordenados);
+    return lsn;
+}
 
-            default:
-                printf("Opcion no valida.\n");
+// Abrir la bitacora y reconstruir el estado: snapshot + registros posteriores.
+// Devuelve el numero de operaciones reaplicadas, o -1 si no se pudo abrir.
+long abrirBitacora(Bitacora* b, NodoAVL** raiz) {
+    iniciarSincronizacion(b);
+    b->lsn = cargarSnapshot(raiz);
+
+    b->fd = open(ARCHIVO_BITACORA, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (b->fd < 0) {
+        perror("Error abriendo bitacora");
+        return -1;
+    }
+    // Si el archivo es nuevo, su entrada en el directorio tambien debe ser durable
+    if (!sincronizarDirectorio())
+        perror("Error sincronizando directorio de la bitacora");
+    b->conConfirmador = pthread_create(&b->confirmador, NULL, confirmarEnSegundoPlano, b) == 0;
+
+    struct stat info;
+    if (fstat(b->fd, &info) != 0 || info.st_size == 0)
+        return 0;
+
+    unsigned char* datos = (unsigned char*)malloc((size_t)info.st_size);
+    size_t total = 0;
+    while (total < (size_t)info.st_size) {
+        ssize_t n = pread(b->fd, datos + total, (size_t)info.st_size - total, (off_t)total);
+        if (n <= 0)
+            break;
+        total += (size_t)n;
+    }
+
+    long reaplicadas = 0;
+    size_t pos = 0;
+    while (pos + REGISTRO_CABECERA + 4 <= total) {
+        unsigned char* p = datos + pos;
+        size_t largo = p[9];
+        if (largo > 49 || pos + REGISTRO_CABECERA + largo + 4 > total)
+            break;
+        uint32_t suma;
+        memcpy(&suma, p + REGISTRO_CABECERA + largo, 4);
+        if (suma != sumaRegistro(p, REGISTRO_CABECERA + largo))
+            break;
+
+        uint64_t lsn;
+        int32_t fecha, cantidad;
+        char texto[50];
+        memcpy(&lsn, p, 8);
+        memcpy(&fecha, p + 10, 4);
+        memcpy(&cantidad, p + 14, 4);
+        memcpy(texto, p + REGISTRO_CABECERA, largo);
+        texto[largo] = 0;
+
+        if (lsn > b->lsn) {
+            aplicarOperacion(raiz, p[8], fecha, cantidad, texto);
+            b->lsn = lsn;
+            reaplicadas++;
         }
-    } while (opcion != 6);
+        pos += REGISTRO_CABECERA + largo + 4;
+    }
+    free(datos);
 
-    // Liberar toda la memoria antes de salir
-    liberarAVL(raiz);
+    // Un registro incompleto al final es una escritura interrumpida: se descarta
+    if (pos < (size_t)info.st_size && ftruncate(b->fd, (off_t)pos) != 0)
+        perror("Error recortando bitacora");
 
-    return 0;
-}#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+    b->registrosDesdeSnapshot = reaplicadas;
+    return reaplicadas;
+}
 
-// ESTRUCTURAS DE DATOS//
-// Nodo de la cola FIFO (pedidos)
-typedef struct Pedido {
+// Detener el confirmador, confirmar lo pendiente y cerrar el archivo
+void cerrarBitacora(Bitacora* b) {
+    if (b->fd < 0)
+        return;
+    if (b->conConfirmador) {
+        pthread_mutex_lock(&b->candado);
+        b->detener = 1;
+        pthread_cond_broadcast(&b->cambio);
+        pthread_mutex_unlock(&b->candado);
+        pthread_join(b->confirmador, NULL);
+        b->conConfirmador = 0;
+    }
+    confirmarBitacora(b);
+    close(b->fd);
+    b->fd = -1;
+}
+
+// Usar el sistema solo en memoria, sin archivos de bitacora ni snapshot
+void desactivarBitacora(Bitacora* b) {
+    iniciarSincronizacion(b);
+    b->fd = -1;
+    b->lsn = 0;
+}
+
+// ================= MOTOR DE DESPACHO MULTI-MUELLE =================
+// Varios muelles (hilos) atienden ordenes de despacho en paralelo. El arbol
+// se protege con un candado lector-escritor: los despachos solo cambian
+// stock y cola de un lote, asi que lo toman en modo lectura y se excluyen
+// entre si con un candado por lote (repartido en franjas por fecha). Las
+// altas y bajas de lotes, y la copia de caminos compartidos con una version
+// abierta, toman el candado de escritura. Cada muelle tiene su propia cola
+// doble; el que se queda sin trabajo roba la mitad de la cola de otro.
+// Bajo esos candados los despachos solo anotan en la bitacora: la escritura
+// y el fdatasync los hace el confirmador, y si la bitacora esta llena la
+// orden se reintenta despues de soltarlos.
+#define MAX_MUELLES 64
+#define FRANJAS_LOTE 256        // Candados de lote (fecha % FRANJAS_LOTE)
+#define LOTE_MUELLE 32          // Ordenes atendidas por cada toma del candado
+
+typedef struct OrdenDespacho {
+    int fecha;
+    int cantidad;
     char destino[50];
+} OrdenDespacho;
+
+struct MotorDespacho;
+
+typedef struct Muelle {
+    int id;
+    pthread_t hilo;
+    pthread_mutex_t candado;
+    OrdenDespacho* ordenes;     // Anillo: el dueño toma del frente, los ladrones del final
+    int capacidad;
+    int inicio;
     int cantidad;
-    struct Pedido* siguiente;
-} Pedido;
+    long procesadas;
+    long rechazadas;            // Lote inexistente o stock insuficiente
+    long robadas;               // Ordenes tomadas de otros muelles
+    struct MotorDespacho* motor;
+} Muelle;
+
+typedef struct MotorDespacho {
+    NodoAVL** raiz;
+    Bitacora* bitacora;
+    pthread_rwlock_t candadoArbol;
+    pthread_mutex_t candadosLote[FRANJAS_LOTE];
+    Muelle muelles[MAX_MUELLES];
+    int numMuelles;
+    int arrancado;
+    atomic_int enCola;          // Ordenes esperando en alguna cola
+    atomic_int pendientes;      // Ordenes aun no resueltas
+    int cerrando;
+    pthread_mutex_t candadoEspera;
+    pthread_cond_t hayTrabajo;
+    pthread_cond_t terminado;
+} MotorDespacho;
+
+// Agregar una orden al final de la cola del muelle (la cola crece si se llena)
+void empujarOrden(Muelle* mu, int fecha, const char* destino, int cantidad) {
+    pthread_mutex_lock(&mu->candado);
+    if (mu->cantidad == mu->capacidad) {
+        int nueva = mu->capacidad ? mu->capacidad * 2 : 256;
+        OrdenDespacho* ordenes = (OrdenDespacho*)malloc(sizeof(OrdenDespacho) * nueva);
+        for (int i = 0; i < mu->cantidad; i++)
+            ordenes[i] = mu->ordenes[(mu->inicio + i) % mu->capacidad];
+        free(mu->ordenes);
+        mu->ordenes = ordenes;
+        mu->capacidad = nueva;
+        mu->inicio = 0;
+    }
+    OrdenDespacho* o = &mu->ordenes[(mu->inicio + mu->cantidad) % mu->capacidad];
+    o->fecha = fecha;
+    o->cantidad = cantidad;
+    strncpy(o->destino, destino, 49);
+    o->destino[49] = 0;
+    mu->cantidad++;
+    pthread_mutex_unlock(&mu->candado);
+}
 
-// Nodo del árbol AVL
-typedef struct NodoAVL {
-    int fecha;              // Clave: AAAAMMDD
-    char producto[50];
-    int stock;
-    Pedido* cabeza;         // Cola FIFO de pedidos
-    int altura;
-    struct NodoAVL* izquierda;
-    struct NodoAVL* derecha;
-} NodoAVL;
+// Tomar hasta max ordenes: del frente (dueño) o del final (robo)
+int tomarOrdenes(Muelle* mu, OrdenDespacho* lote, int max, int delFinal) {
+    pthread_mutex_lock(&mu->candado);
+    int n = mu->cantidad;
+    if (delFinal)
+        n = (n + 1) / 2;        // Robar la mitad deja trabajo al dueño
+    if (n > max)
+        n = max;
+    for (int i = 0; i < n; i++) {
+        int pos = delFinal ? mu->inicio + mu->cantidad - n + i : mu->inicio + i;
+        lote[i] = mu->ordenes[pos % mu->capacidad];
+    }
+    if (!delFinal)
+        mu->inicio = mu->capacidad ? (mu->inicio + n) % mu->capacidad : 0;
+    mu->cantidad -= n;
+    pthread_mutex_unlock(&mu->candado);
+    return n;
+}
+
+// Buscar un lote para cambiarlo en sitio bajo el candado de lectura. Retorna 0
+// si el camino esta compartido con una version (hay que copiarlo con escritura).
+int buscarEnSitio(NodoAVL* raiz, int fecha, NodoAVL** nodo) {
+    *nodo = NULL;
+    EST_SUMAR(estadisticas.descensos, 1);
+    while (raiz != NULL) {
+        EST_SUMAR(estadisticas.nodosVisitados, 1);
+        if (atomic_load(&raiz->refs) > 1)
+            return 0;
+        if (fecha == raiz->fecha) {
+            *nodo = raiz;
+            return 1;
+        }
+        raiz = fecha < raiz->fecha ? raiz->izquierda : raiz->derecha;
+    }
+    return 1;
+}
+
+// Encolar el pedido en el lote si hay stock; se anota antes de aplicarse.
+// Devuelve 1 si se despacho, 0 si se rechazo o BITACORA_LLENA.
+int despacharEnLote(MotorDespacho* m, NodoAVL* nodo, const OrdenDespacho* o) {
+    EST_INICIO(inicio);
+    pthread_mutex_t* candado = &m->candadosLote[(unsigned)nodo->fecha % FRANJAS_LOTE];
+    int resultado = 0;
+    pthread_mutex_lock(candado);
+    if (o->cantidad <= nodo->stock) {
+        resultado = anotarEnBitacora(m->bitacora, OP_ENCOLAR, nodo->fecha, o->cantidad, o->destino, 0);
+        if (resultado == 1)
+            registrarPedido(nodo, o->destino, o->cantidad);
+    }
+    pthread_mutex_unlock(candado);
+    EST_FIN(estadisticas.despacho, inicio);
+    return resultado;
+}
+
+// Contar el resultado de un despacho; con la bitacora llena la orden se difiere
+void contarDespacho(Muelle* mu, int resultado, int i, int* diferidas, int* numDiferidas) {
+    if (resultado == BITACORA_LLENA)
+        diferidas[(*numDiferidas)++] = i;
+    else if (resultado == 1)
+        mu->procesadas++;
+    else
+        mu->rechazadas++;
+}
 
-// ================= FUNCIONES DE LA COLA FIFO =================
-// Crear un nuevo pedido
-Pedido* crearPedido(const char* destino, int cantidad) {
-    Pedido* nuevo = (Pedido*)malloc(sizeof(Pedido));
-    strcpy(nuevo->destino, destino);
-    nuevo->cantidad = cantidad;
-    nuevo->siguiente = NULL;
-    return nuevo;
+// Atender un lote de ordenes: todo lo posible con lectura, el resto con escritura
+void procesarOrdenes(Muelle* mu, OrdenDespacho* lote, int n) {
+    MotorDespacho* m = mu->motor;
+    int compartidas[LOTE_MUELLE], diferidas[LOTE_MUELLE];
+    int numCompartidas = 0, numDiferidas = 0;
+    NodoAVL* nodo;
+
+    pthread_rwlock_rdlock(&m->candadoArbol);
+    for (int i = 0; i < n; i++) {
+        if (!buscarEnSitio(*m->raiz, lote[i].fecha, &nodo))
+            compartidas[numCompartidas++] = i;
+        else if (nodo == NULL)
+            mu->rechazadas++;
+        else
+            contarDespacho(mu, despacharEnLote(m, nodo, &lote[i]), i, diferidas, &numDiferidas);
+    }
+    pthread_rwlock_unlock(&m->candadoArbol);
+
+    if (numCompartidas > 0) {
+        pthread_rwlock_wrlock(&m->candadoArbol);
+        for (int i = 0; i < numCompartidas; i++) {
+            OrdenDespacho* o = &lote[compartidas[i]];
+            nodo = buscarParaModificar(m->raiz, o->fecha);
+            if (nodo == NULL)
+                mu->rechazadas++;
+            else
+                contarDespacho(mu, despacharEnLote(m, nodo, o), compartidas[i], diferidas, &numDiferidas);
+        }
+        pthread_rwlock_unlock(&m->candadoArbol);
+    }
+
+    // Bitacora llena: esperar al disco ya sin candados del arbol y reintentar
+    if (numDiferidas == 0)
+        return;
+    OrdenDespacho resto[LOTE_MUELLE];
+    for (int i = 0; i < numDiferidas; i++)
+        resto[i] = lote[diferidas[i]];
+    confirmarBitacora(m->bitacora);
+    procesarOrdenes(mu, resto, numDiferidas);
 }
 
-// Agregar pedido al final de la cola
-void encolar(Pedido** cabeza, const char* destino, int cantidad) {
-    Pedido* nuevo = crearPedido(destino, cantidad);
-    if (*cabeza == NULL) {
-        *cabeza = nuevo;
-    } else {
-        Pedido* temp = *cabeza;
-        while (temp->siguiente != NULL) {
-            temp = temp->siguiente;
+// Robar ordenes del primer muelle con trabajo, empezando por el vecino
+int robarOrdenes(Muelle* mu, OrdenDespacho* lote) {
+    MotorDespacho* m = mu->motor;
+    for (int k = 1; k < m->numMuelles; k++) {
+        Muelle* victima = &m->muelles[(mu->id + k) % m->numMuelles];
+        int n = tomarOrdenes(victima, lote, LOTE_MUELLE, 1);
+        if (n > 0) {
+            mu->robadas += n;
+            return n;
         }
-        temp->siguiente = nuevo;
     }
+    return 0;
 }
 
-// Eliminar un pedido específico de la cola//
-int cancelarPedido(Pedido** cabeza, const char* destino, int cantidad, NodoAVL* nodo) {
-    Pedido* actual = *cabeza;
-    Pedido* anterior = NULL;
+// Ciclo de un muelle: su cola, luego robo, luego espera
+void* trabajarMuelle(void* arg) {
+    Muelle* mu = (Muelle*)arg;
+    MotorDespacho* m = mu->motor;
+    OrdenDespacho lote[LOTE_MUELLE];
+
+    while (1) {
+        int n = tomarOrdenes(mu, lote, LOTE_MUELLE, 0);
+        if (n == 0)
+            n = robarOrdenes(mu, lote);
+        if (n == 0) {
+            pthread_mutex_lock(&m->candadoEspera);
+            while (atomic_load(&m->enCola) == 0 && !m->cerrando)
+                pthread_cond_wait(&m->hayTrabajo, &m->candadoEspera);
+            int salir = m->cerrando && atomic_load(&m->enCola) == 0;
+            pthread_mutex_unlock(&m->candadoEspera);
+            if (salir)
+                break;
+            continue;
+        }
 
-    while (actual != NULL) {
-        if (strcmp(actual->destino, destino) == 0 && actual->cantidad == cantidad) {
-            if (anterior == NULL) {
-                *cabeza = actual->siguiente;
-            } else {
-                anterior->siguiente = actual->siguiente;
-            }
-            nodo->stock += actual->cantidad; // Restaurar stock
-            free(actual);
-            return 1; // Eliminado
+        atomic_fetch_sub(&m->enCola, n);
+        procesarOrdenes(mu, lote, n);
+        if (atomic_fetch_sub(&m->pendientes, n) == n) {
+            pthread_mutex_lock(&m->candadoEspera);
+            pthread_cond_broadcast(&m->terminado);
+            pthread_mutex_unlock(&m->candadoEspera);
         }
-        anterior = actual;
-        actual = actual->siguiente;
     }
-    return 0; // No encontrado
+    return NULL;
 }
 
-// Liberar toda la cola de pedidos//
-void liberarCola(Pedido* cabeza) {
-    Pedido* temp;
-    while (cabeza != NULL) {
-        temp = cabeza;
-        cabeza = cabeza->siguiente;
-        free(temp);
+// Preparar el motor sobre un inventario; los muelles arrancan con arrancarMuelles
+void iniciarMotor(MotorDespacho* m, NodoAVL** raiz, Bitacora* b, int numMuelles) {
+    if (numMuelles < 1)
+        numMuelles = 1;
+    if (numMuelles > MAX_MUELLES)
+        numMuelles = MAX_MUELLES;
+
+    m->raiz = raiz;
+    m->bitacora = b;
+    m->numMuelles = numMuelles;
+    m->arrancado = 0;
+    m->cerrando = 0;
+    atomic_init(&m->enCola, 0);
+    atomic_init(&m->pendientes, 0);
+    pthread_rwlock_init(&m->candadoArbol, NULL);
+    for (int i = 0; i < FRANJAS_LOTE; i++)
+        pthread_mutex_init(&m->candadosLote[i], NULL);
+    pthread_mutex_init(&m->candadoEspera, NULL);
+    pthread_cond_init(&m->hayTrabajo, NULL);
+    pthread_cond_init(&m->terminado, NULL);
+
+    for (int i = 0; i < numMuelles; i++) {
+        Muelle* mu = &m->muelles[i];
+        memset(mu, 0, sizeof(Muelle));
+        mu->id = i;
+        mu->motor = m;
+        pthread_mutex_init(&mu->candado, NULL);
     }
 }
 
-// Contar pedidos en la cola
-int contarPedidos(Pedido* cabeza) {
-    int contador = 0;
-    Pedido* temp = cabeza;
-    while (temp != NULL) {
-        contador++;
-        temp = temp->siguiente;
+// Lanzar un hilo por muelle
+void arrancarMuelles(MotorDespacho* m) {
+    for (int i = 0; i < m->numMuelles; i++)
+        pthread_create(&m->muelles[i].hilo, NULL, trabajarMuelle, &m->muelles[i]);
+    m->arrancado = 1;
+}
+
+// Asignar una orden de despacho a un muelle
+void enviarOrden(MotorDespacho* m, int muelle, int fecha, const char* destino, int cantidad) {
+    empujarOrden(&m->muelles[muelle % m->numMuelles], fecha, destino, cantidad);
+    atomic_fetch_add(&m->pendientes, 1);
+    atomic_fetch_add(&m->enCola, 1);
+    pthread_mutex_lock(&m->candadoEspera);
+    pthread_cond_signal(&m->hayTrabajo);
+    pthread_mutex_unlock(&m->candadoEspera);
+}
+
+// Esperar a que todas las ordenes enviadas esten resueltas y confirmadas en
+// la bitacora; devuelve 0 si la confirmacion fallo
+int esperarMotor(MotorDespacho* m) {
+    pthread_mutex_lock(&m->candadoEspera);
+    while (atomic_load(&m->pendientes) > 0)
+        pthread_cond_wait(&m->terminado, &m->candadoEspera);
+    pthread_mutex_unlock(&m->candadoEspera);
+    return confirmarBitacora(m->bitacora);
+}
+
+// Recepcion de mercancia concurrente con los muelles
+int recibirEnMotor(MotorDespacho* m, int fecha, const char* producto, int stock) {
+    int ok = 0;
+    pthread_rwlock_wrlock(&m->candadoArbol);
+    if (buscarNodo(*m->raiz, fecha) == NULL &&
+        registrarEnBitacora(m->bitacora, OP_INSERTAR, fecha, stock, producto)) {
+        *m->raiz = insertarAVL(*m->raiz, fecha, producto, stock);
+        ok = 1;
     }
-    return contador;
+    pthread_rwlock_unlock(&m->candadoArbol);
+    return ok;
 }
 
-// FUNCIONES DEL ÁRBOL AVL
-// Función auxiliar para obtener la altura
-int altura(NodoAVL* nodo) {
-    if (nodo == NULL)
-        return 0;
-    return nodo->altura;
+// Eliminar un lote y sus pedidos concurrentemente con los muelles
+int eliminarEnMotor(MotorDespacho* m, int fecha) {
+    int ok = 0;
+    pthread_rwlock_wrlock(&m->candadoArbol);
+    if (buscarNodo(*m->raiz, fecha) != NULL && registrarEnBitacora(m->bitacora, OP_ELIMINAR, fecha, 0, NULL)) {
+        *m->raiz = eliminarNodoAVL(*m->raiz, fecha);
+        ok = 1;
+    }
+    pthread_rwlock_unlock(&m->candadoArbol);
+    return ok;
 }
 
-// Función para obtener el máximo de dos enteros//
-int maximo(int a, int b) {
-    return (a > b) ? a : b;
+// Cancelar un pedido concurrentemente con los muelles
+int cancelarEnMotor(MotorDespacho* m, int fecha, const char* destino, int cantidad) {
+    int ok = 0;
+    pthread_rwlock_wrlock(&m->candadoArbol);
+    NodoAVL* nodo = buscarParaModificar(m->raiz, fecha);
+    if (nodo != NULL && buscarPedido(nodo->cabeza, destino, cantidad) != NULL &&
+        registrarEnBitacora(m->bitacora, OP_CANCELAR, fecha, cantidad, destino))
+        ok = cancelarPedido(&(nodo->cabeza), destino, cantidad, nodo);
+    pthread_rwlock_unlock(&m->candadoArbol);
+    return ok;
 }
 
-// Crear un nuevo nodo AVL
-NodoAVL* crearNodoAVL(int fecha, const char* producto, int stock) {
-    NodoAVL* nodo = (NodoAVL*)malloc(sizeof(NodoAVL));
-    nodo->fecha = fecha;
-    strcpy(nodo->producto, producto);
-    nodo->stock = stock;
-    nodo->cabeza = NULL;
-    nodo->altura = 1;
-    nodo->izquierda = NULL;
-    nodo->derecha = NULL;
-    return nodo;
+// Abrir una version para reportes; el candado de escritura asegura que
+// ningun muelle este a mitad de un despacho en ese instante
+NodoAVL* abrirVersionMotor(MotorDespacho* m) {
+    pthread_rwlock_wrlock(&m->candadoArbol);
+    NodoAVL* version = abrirVersion(*m->raiz);
+    pthread_rwlock_unlock(&m->candadoArbol);
+    return version;
+}
+
+// Compactar el inventario por tramos; entre tramos los muelles siguen despachando
+void compactarEnMotor(MotorDespacho* m, Compactacion* c) {
+    int quedan = 1;
+    iniciarCompactacion(c);
+    while (quedan) {
+        pthread_rwlock_wrlock(&m->candadoArbol);
+        quedan = compactarPaso(m->raiz, c, PASO_COMPACTACION);
+        pthread_rwlock_unlock(&m->candadoArbol);
+    }
 }
 
-// Rotación simple a la derecha//
-NodoAVL* rotarDerecha(NodoAVL* y) {
-    NodoAVL* x = y->izquierda;
-    NodoAVL* T2 = x->derecha;
+// Atender lo pendiente, detener los muelles, confirmar la bitacora y
+// liberar sus colas; devuelve 0 si la confirmacion fallo
+int detenerMotor(MotorDespacho* m) {
+    pthread_mutex_lock(&m->candadoEspera);
+    m->cerrando = 1;
+    pthread_cond_broadcast(&m->hayTrabajo);
+    pthread_mutex_unlock(&m->candadoEspera);
+
+    // Unir todos los hilos antes de destruir nada: un muelle que sigue vivo
+    // todavia puede robar de la cola de otro ya terminado
+    if (m->arrancado)
+        for (int i = 0; i < m->numMuelles; i++)
+            pthread_join(m->muelles[i].hilo, NULL);
+    int ok = confirmarBitacora(m->bitacora);
+    for (int i = 0; i < m->numMuelles; i++) {
+        free(m->muelles[i].ordenes);
+        m->muelles[i].ordenes = NULL;
+        pthread_mutex_destroy(&m->muelles[i].candado);
+    }
+    for (int i = 0; i < FRANJAS_LOTE; i++)
+        pthread_mutex_destroy(&m->candadosLote[i]);
+    pthread_rwlock_destroy(&m->candadoArbol);
+    pthread_mutex_destroy(&m->candadoEspera);
+    pthread_cond_destroy(&m->hayTrabajo);
+    pthread_cond_destroy(&m->terminado);
+    return ok;
+}
 
-    x->derecha = y;
-    y->izquierda = T2;
+// ================= ESTADISTICAS DEL MOTOR =================
+#define CUBETAS_COLA 12         // Largo de cola: 0, 1, 2-3, 4-7, ... 1024+
 
-    y->altura = maximo(altura(y->izquierda), altura(y->derecha)) + 1;
-    x->altura = maximo(altura(x->izquierda), altura(x->derecha)) + 1;
+// Recorrer los lotes acumulando la distribucion de largos de cola
+void medirColas(NodoAVL* nodo, long* cubetas, long* lotes, long* pedidos, int* maximoCola) {
+    if (nodo == NULL)
+        return;
+    medirColas(nodo->izquierda, cubetas, lotes, pedidos, maximoCola);
+    int largo = contarPedidos(nodo->cabeza);
+    int cubeta = largo ? 1 + (31 - __builtin_clz((unsigned)largo)) : 0;
+    cubetas[cubeta < CUBETAS_COLA ? cubeta : CUBETAS_COLA - 1]++;
+    (*lotes)++;
+    *pedidos += largo;
+    *maximoCola = maximo(*maximoCola, largo);
+    medirColas(nodo->derecha, cubetas, lotes, pedidos, maximoCola);
+}
 
-    return x;
+// Volcar contadores, histogramas y el estado de las colas de una version
+void imprimirEstadisticas(FILE* salida, NodoAVL* version) {
+    EstadisticasAVL* e = &estadisticas;
+    long cubetas[CUBETAS_COLA] = {0};
+    long lotes = 0, pedidos = 0;
+    int maximoCola = 0;
+    medirColas(version, cubetas, &lotes, &pedidos, &maximoCola);
+
+    fprintf(salida, "\n=== ESTADISTICAS DEL MOTOR ===\n");
+    fprintf(salida, "Altura actual: %d | Lotes: %ld\n", lotesAltura(version), lotes);
+    fprintf(salida, "Rotaciones: LL=%llu RR=%llu LR=%llu RL=%llu\n",
+            (unsigned long long)e->rotacionesLL, (unsigned long long)e->rotacionesRR,
+            (unsigned long long)e->rotacionesLR, (unsigned long long)e->rotacionesRL);
+    fprintf(salida, "Descensos: %llu | Nodos visitados por descenso: %.2f\n",
+            (unsigned long long)e->descensos,
+            e->descensos ? (double)e->nodosVisitados / e->descensos : 0.0);
+    fprintf(salida, "Nodos creados/liberados: %llu/%llu | Copias por version: %llu\n",
+            (unsigned long long)e->nodosCreados, (unsigned long long)e->nodosLiberados,
+            (unsigned long long)e->copiasPorVersion);
+    fprintf(salida, "Pedidos creados/liberados: %llu/%llu\n",
+            (unsigned long long)e->pedidosCreados, (unsigned long long)e->pedidosLiberados);
+
+    uint64_t muestras = e->mutaciones ? 1 + (e->mutaciones - 1) / MUTACIONES_POR_MUESTRA : 0;
+    uint64_t primera = muestras > MUESTRAS_ALTURA ? muestras - MUESTRAS_ALTURA : 0;
+    fprintf(salida, "Altura cada %d mutaciones:", MUTACIONES_POR_MUESTRA);
+    for (uint64_t i = primera; i < muestras; i++)
+        fprintf(salida, " %d", e->alturas[i % MUESTRAS_ALTURA]);
+    fprintf(salida, "\n");
+
+    fprintf(salida, "Colas: %ld pedidos, promedio %.2f por lote, maximo %d\n",
+            pedidos, lotes ? (double)pedidos / lotes : 0.0, maximoCola);
+    fprintf(salida, "  Lotes por largo de cola:");
+    for (int i = 0; i < CUBETAS_COLA; i++) {
+        if (cubetas[i] == 0)
+            continue;
+        if (i == 0)
+            fprintf(salida, " [0]=%ld", cubetas[i]);
+        else
+            fprintf(salida, " [%d-%d]=%ld", 1 << (i - 1), (1 << i) - 1, cubetas[i]);
+    }
+    fprintf(salida, "\n");
+
+    fprintf(salida, "Latencias:\n");
+    imprimirHistograma(salida, "insertar", &e->insertar);
+    imprimirHistograma(salida, "eliminar", &e->eliminar);
+    imprimirHistograma(salida, "buscar", &e->buscar);
+    imprimirHistograma(salida, "despacho", &e->despacho);
+    imprimirHistograma(salida, "cancelacion", &e->cancelacion);
 }
 
-// Rotación simple a la izquierda
-NodoAVL* rotarIzquierda(NodoAVL* x) {
-    NodoAVL* y = x->derecha;
-    NodoAVL* T2 = y->izquierda;
+// ================= REPORTE DE CIERRE =================
+// Acumulados del inventario en un recorrido paralelo: stock total, pedidos
+// en cola y, en la tabla, pedidos y unidades por destino
+#define SUMA_STOCK 0
+#define SUMA_PEDIDOS 1
+#define SUMA_UNIDADES 2
+
+void acumularLote(const void* nodo, ParcialRecorrido* parcial, void* contexto) {
+    const NodoAVL* lote = (const NodoAVL*)nodo;
+    (void)contexto;
+    parcial->sumas[SUMA_STOCK] += lote->stock;
+    for (Pedido* p = lote->cabeza; p != NULL; p = p->siguiente) {
+        parcial->sumas[SUMA_PEDIDOS]++;
+        parcial->sumas[SUMA_UNIDADES] += p->cantidad;
+        sumarEnTabla(&parcial->tabla, p->destino, 1, p->cantidad);
+    }
+}
 
-    y->izquierda = x;
-    x->derecha = T2;
+// Acumular una version del inventario (el llamador libera el resultado)
+void acumularInventario(PoolRecorrido* pool, NodoAVL* version, ParcialRecorrido* total) {
+    RecorridoParalelo r = {offsetof(NodoAVL, izquierda), offsetof(NodoAVL, derecha),
+                           acumularLote, NULL, 0};
+    iniciarParcial(total);
+    recorrerEnParalelo(pool, &r, version, total, NULL);
+}
 
-    x->altura = maximo(altura(x->izquierda), altura(x->derecha)) + 1;
-    y->altura = maximo(altura(y->izquierda), altura(y->derecha)) + 1;
+void imprimirReporteCierre(FILE* salida, PoolRecorrido* pool, NodoAVL* version) {
+    ParcialRecorrido total;
+    acumularInventario(pool, version, &total);
+    fprintf(salida, "\n=== REPORTE DE CIERRE (%d hilos) ===\n", pool->numHilos + 1);
+    fprintf(salida, "Lotes: %lld | Stock total: %lld\n", total.nodos, total.sumas[SUMA_STOCK]);
+    fprintf(salida, "Pedidos en cola: %lld | Unidades pedidas: %lld\n",
+            total.sumas[SUMA_PEDIDOS], total.sumas[SUMA_UNIDADES]);
+    EntradaConteo* destinos = ordenarTabla(&total.tabla);
+    for (size_t i = 0; i < total.tabla.usadas; i++)
+        fprintf(salida, "  %-30s %8lld pedidos %10lld unidades\n", destinos[i].clave,
+                destinos[i].conteo, destinos[i].suma);
+    free(destinos);
+    liberarParcial(&total);
+}
 
-    return y;
+// ================= ALERTAS DE VENCIMIENTO =================
+// Ordinal del dia de hoy segun el reloj local
+int diaDeHoy() {
+    time_t ahora = time(NULL);
+    struct tm local;
+    localtime_r(&ahora, &local);
+    return ordinalDia((local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday);
 }
 
-// Obtener el factor de balance//
-int balanceFactor(NodoAVL* nodo) {
+void clasificarArbol(Calendario* c, NodoAVL* nodo) {
     if (nodo == NULL)
-        return 0;
-    return altura(nodo->izquierda) - altura(nodo->derecha);
+        return;
+    clasificarArbol(c, nodo->izquierda);
+    clasificarEnCalendario(c, nodo);
+    clasificarArbol(c, nodo->derecha);
 }
 
-// Insertar en el árbol AVL
-NodoAVL* insertarAVL(NodoAVL* nodo, int fecha, const char* producto, int stock) {
+// Construir el calendario desde cero recorriendo el arbol (O(n), solo al arrancar
+// o cuando el reloj salta mas alla del horizonte)
+void reconstruirCalendario(Calendario* c, NodoAVL* raiz, int hoy) {
+    memset(c, 0, sizeof(*c));
+    c->diaBase = hoy;
+    c->proximo = -1;
+    clasificarArbol(c, raiz);
+}
+
+// Pasar al dia de hoy: los dias que quedan atras pasan a vencidos y por cada
+// dia que entra al final del horizonte se busca su lote en el AVL (O(log n))
+void avanzarCalendario(Calendario* c, NodoAVL* raiz, int hoy) {
+    if (hoy == c->diaBase)
+        return;
+    if (hoy < c->diaBase || hoy - c->diaBase >= HORIZONTE_DIAS) {
+        reconstruirCalendario(c, raiz, hoy);
+        return;
+    }
+    for (int dia = c->diaBase; dia < hoy; dia++) {
+        int ranura = ranuraDia(dia);
+        if (c->dias[ranura] != NULL) {
+            c->dias[ranura] = NULL;
+            c->ocupados[ranura / 64] &= ~(1ull << (ranura % 64));
+            c->enHorizonte--;
+            c->vencidos++;
+        }
+        // La misma ranura pasa a representar el dia dia + HORIZONTE_DIAS
+        if (c->lejanos > 0) {
+            NodoAVL* lejano = buscarNodo(raiz, fechaDesdeOrdinal(dia + HORIZONTE_DIAS));
+            if (lejano != NULL) {
+                c->dias[ranura] = lejano;
+                c->ocupados[ranura / 64] |= 1ull << (ranura % 64);
+                c->enHorizonte++;
+                c->lejanos--;
+            }
+        }
+    }
+    c->diaBase = hoy;
+    c->proximo = buscarDiaOcupado(c, hoy);
+}
+
+// Proximo lote por vencer desde hoy, sin recorrer el arbol
+NodoAVL* proximoAVencer(Calendario* c) {
+    return c->proximo < 0 ? NULL : c->dias[ranuraDia(c->proximo)];
+}
+
+// Lote que vence el dia indicado (ordinal), o NULL
+NodoAVL* loteQueVence(Calendario* c, int dia) {
+    if (dia < c->diaBase || dia >= c->diaBase + HORIZONTE_DIAS)
+        return NULL;
+    return c->dias[ranuraDia(dia)];
+}
+
+// Listar los lotes que vencen en los proximos dias; devuelve cuantos hay
+int alertasVencimiento(FILE* salida, Calendario* c, int dias) {
+    int alertas = 0;
+    int fin = c->diaBase + (dias < HORIZONTE_DIAS ? dias : HORIZONTE_DIAS);
+    for (int dia = c->proximo; dia >= 0 && dia < fin; dia = buscarDiaOcupado(c, dia + 1)) {
+        NodoAVL* lote = c->dias[ranuraDia(dia)];
+        fprintf(salida, "  Vence en %d dia(s): %s (Fecha: %d, Stock: %d, Pedidos: %d)\n",
+                dia - c->diaBase, lote->producto, lote->fecha, lote->stock,
+                contarPedidos(lote->cabeza));
+        alertas++;
+    }
+    return alertas;
+}
+
+// ================= SERVIDOR DE TERMINALES =================
+// Modo servidor: un solo hilo con epoll atiende a todas las terminales de los
+// muelles sobre un socket Unix y comparte con ellas el mismo inventario. Las
+// respuestas salen en el orden de las solicitudes, asi que un cliente puede
+// enviar muchas sin esperar. Todo lo aplicado en una vuelta del ciclo se
+// confirma en la bitacora con un solo fdatasync antes de responder.
+//
+// Solicitud: tipo(1) largo(1) fecha(4) cantidad(4) texto(largo)
+// Respuesta: tipo(1) estado(1) largo(4) datos(largo)
+//   recibir, despachar, eliminar, cancelar -> fecha(4) stock(4)
+//   reporte -> version(8) lotes(4) y por lote: fecha(4) stock(4) pedidos(4) largo(1) producto
+//   cambios -> version(8) cambios(4) y por cambio: tipo(1) y el lote como en
+//              el reporte (una baja va solo con la fecha, lo demas en cero)
+// La version de un reporte (o de unos cambios) sirve para pedir despues solo
+// los cambios desde ahi; viaja en fecha (32 bits bajos) y cantidad (altos).
+// Los enteros van en el orden de bytes de la maquina: el socket es local.
+#define SOL_RECIBIR 1
+#define SOL_DESPACHAR 2         // fecha 0: el lote mas proximo a vencer
+#define SOL_ELIMINAR 3
+#define SOL_CANCELAR 4
+#define SOL_REPORTE 5
+#define SOL_CAMBIOS 6
+
+#define RESP_OK 0
+#define RESP_NO_EXISTE 1
+#define RESP_YA_EXISTE 2
+#define RESP_SIN_STOCK 3
+#define RESP_SIN_PEDIDO 4
+#define RESP_INVALIDA 5
+#define RESP_VERSION_VIEJA 6     // Sin registro desde esa version: pedir un reporte
+#define RESP_SIN_BITACORA 7      // No se pudo anotar en la bitacora; no se aplico
+
+#define CABECERA_SOLICITUD 10
+#define CABECERA_RESPUESTA 6
+#define ENTRADA_SESION 65536
+#define LIMITE_SALIDA (1 << 20) // Dejar de leer a quien no consume sus respuestas
+#define MAX_EVENTOS 64
+
+typedef struct Sesion {
+    int fd;
+    char entrada[ENTRADA_SESION];
+    size_t leidos;
+    char* salida;
+    size_t largoSalida, enviados, capacidadSalida;
+    int cerrada;                    // El cliente ya no enviara mas
+    int fallo;                      // Error de lectura o escritura
+    int eventos;                    // Eventos registrados en epoll
+    int enRonda;
+    struct Sesion* siguienteRonda;
+    struct Sesion* anterior;
+    struct Sesion* siguiente;
+} Sesion;
+
+volatile sig_atomic_t servidorDetenido = 0;
+
+void detenerServidor(int senal) {
+    (void)senal;
+    servidorDetenido = 1;
+}
+
+// Espacio para n bytes mas al final de la salida de una sesion. Sin memoria
+// la sesion queda con fallo (se cierra sin responder mas) y lo que se escriba
+// va a un descarte; ninguna reserva pasa de un lote serializado.
+char* reservarSalida(Sesion* s, size_t n) {
+    static char descarte[CABECERA_RESPUESTA + 13 + 255];
+    if (s->largoSalida + n > s->capacidadSalida) {
+        size_t capacidad = s->capacidadSalida ? s->capacidadSalida : 4096;
+        while (capacidad < s->largoSalida + n)
+            capacidad *= 2;
+        char* salida = (char*)realloc(s->salida, capacidad);
+        if (salida == NULL) {
+            s->fallo = 1;
+            return descarte;
+        }
+        s->salida = salida;
+        s->capacidadSalida = capacidad;
+    }
+    char* p = s->salida + s->largoSalida;
+    s->largoSalida += n;
+    return p;
+}
+
+void cabeceraRespuesta(char* p, int tipo, int estado, uint32_t largo) {
+    p[0] = (char)tipo;
+    p[1] = (char)estado;
+    memcpy(p + 2, &largo, 4);
+}
+
+// Respuesta con el estado del lote afectado
+void responderLote(Sesion* s, int tipo, int estado, int fecha, int stock) {
+    char* p = reservarSalida(s, CABECERA_RESPUESTA + 8);
+    int32_t f = fecha, st = stock;
+    cabeceraRespuesta(p, tipo, estado, 8);
+    memcpy(p + CABECERA_RESPUESTA, &f, 4);
+    memcpy(p + CABECERA_RESPUESTA + 4, &st, 4);
+}
+
+void serializarLote(Sesion* s, NodoAVL* nodo) {
+    unsigned char largo = (unsigned char)strlen(nodo->producto);
+    char* p = reservarSalida(s, 13 + largo);
+    int32_t valores[3] = {nodo->fecha, nodo->stock, contarPedidos(nodo->cabeza)};
+    memcpy(p, valores, 12);
+    p[12] = (char)largo;
+    memcpy(p + 13, nodo->producto, largo);
+}
+
+void serializarLotes(Sesion* s, NodoAVL* nodo) {
     if (nodo == NULL)
-        return crearNodoAVL(fecha, producto, stock);
+        return;
+    serializarLotes(s, nodo->izquierda);
+    serializarLote(s, nodo);
+    serializarLotes(s, nodo->derecha);
+}
 
-    if (fecha < nodo->fecha)
-        nodo->izquierda = insertarAVL(nodo->izquierda, fecha, producto, stock);
-    else if (fecha > nodo->fecha)
-        nodo->derecha = insertarAVL(nodo->derecha, fecha, producto, stock);
-    else
-        return nodo; // Fecha duplicada (no permitida según requerimiento)
+// Cambios netos desde una version, con el estado actual de cada lote tocado
+void serializarCambios(Sesion* s, NodoAVL* raiz, int tipo, uint64_t desde) {
+    CambioNeto* cambios;
+    uint64_t version;
+    long n = cambiosDesde(&cambiosLotes, desde, &cambios, &version);
+    if (n < 0) {
+        char* q = reservarSalida(s, CABECERA_RESPUESTA);
+        cabeceraRespuesta(q, tipo, RESP_VERSION_VIEJA, 0);
+        return;
+    }
+    size_t inicio = s->largoSalida;
+    reservarSalida(s, CABECERA_RESPUESTA + 12);
+    for (long i = 0; i < n; i++) {
+        NodoAVL* nodo = cambios[i].tipo == CAMBIO_BAJA ? NULL : buscarNodo(raiz, cambios[i].clave);
+        if (nodo == NULL) {
+            char* p = reservarSalida(s, 14);
+            int32_t valores[3] = {cambios[i].clave, 0, 0};
+            p[0] = (char)CAMBIO_BAJA;
+            memcpy(p + 1, valores, 12);
+            p[13] = 0;
+        } else {
+            *reservarSalida(s, 1) = (char)cambios[i].tipo;
+            serializarLote(s, nodo);
+        }
+    }
+    free(cambios);
+    if (s->fallo)
+        return;
+    uint32_t total = (uint32_t)n;
+    char* cabecera = s->salida + inicio;
+    cabeceraRespuesta(cabecera, tipo, RESP_OK, (uint32_t)(s->largoSalida - inicio - CABECERA_RESPUESTA));
+    memcpy(cabecera + CABECERA_RESPUESTA, &version, 8);
+    memcpy(cabecera + CABECERA_RESPUESTA + 8, &total, 4);
+}
 
-    nodo->altura = 1 + maximo(altura(nodo->izquierda), altura(nodo->derecha));
+// Aplicar una solicitud al inventario y encolar su respuesta
+void atenderSolicitud(Sesion* s, NodoAVL** raiz, Bitacora* b, const char* p) {
+    int tipo = (unsigned char)p[0];
+    size_t largo = (unsigned char)p[1];
+    int32_t fecha, cantidad;
+    char texto[50];
+    memcpy(&fecha, p + 2, 4);
+    memcpy(&cantidad, p + 6, 4);
+    if (largo > 49)
+        largo = 49;
+    memcpy(texto, p + CABECERA_SOLICITUD, largo);
+    texto[largo] = 0;
+
+    NodoAVL* nodo;
+    switch (tipo) {
+        case SOL_RECIBIR:
+            if (!fechaValida(fecha) || cantidad < 0) {
+                responderLote(s, tipo, RESP_INVALIDA, fecha, 0);
+            } else if ((nodo = buscarNodo(*raiz, fecha)) != NULL) {
+                responderLote(s, tipo, RESP_YA_EXISTE, fecha, nodo->stock);
+            } else if (!registrarEnBitacora(b, OP_INSERTAR, fecha, cantidad, texto)) {
+                responderLote(s, tipo, RESP_SIN_BITACORA, fecha, 0);
+            } else {
+                *raiz = insertarAVL(*raiz, fecha, texto, cantidad);
+                responderLote(s, tipo, RESP_OK, fecha, cantidad);
+            }
+            break;
+
+        case SOL_DESPACHAR:
+            nodo = fecha == 0 ? minimoParaModificar(raiz) : buscarParaModificar(raiz, fecha);
+            if (nodo == NULL) {
+                responderLote(s, tipo, RESP_NO_EXISTE, fecha, 0);
+            } else if (cantidad <= 0) {
+                responderLote(s, tipo, RESP_INVALIDA, nodo->fecha, nodo->stock);
+            } else if (cantidad > nodo->stock) {
+                responderLote(s, tipo, RESP_SIN_STOCK, nodo->fecha, nodo->stock);
+            } else if (!registrarEnBitacora(b, OP_ENCOLAR, nodo->fecha, cantidad, texto)) {
+                responderLote(s, tipo, RESP_SIN_BITACORA, nodo->fecha, nodo->stock);
+            } else {
+                registrarPedido(nodo, texto, cantidad);
+                responderLote(s, tipo, RESP_OK, nodo->fecha, nodo->stock);
+            }
+            break;
 
-    int balance = balanceFactor(nodo);
+        case SOL_ELIMINAR:
+            if (buscarNodo(*raiz, fecha) == NULL) {
+                responderLote(s, tipo, RESP_NO_EXISTE, fecha, 0);
+            } else if (!registrarEnBitacora(b, OP_ELIMINAR, fecha, 0, NULL)) {
+                responderLote(s, tipo, RESP_SIN_BITACORA, fecha, 0);
+            } else {
+                *raiz = eliminarNodoAVL(*raiz, fecha);
+                responderLote(s, tipo, RESP_OK, fecha, 0);
+            }
+            break;
+
+        case SOL_CANCELAR:
+            nodo = buscarParaModificar(raiz, fecha);
+            if (nodo == NULL) {
+                responderLote(s, tipo, RESP_NO_EXISTE, fecha, 0);
+            } else if (buscarPedido(nodo->cabeza, texto, cantidad) == NULL) {
+                responderLote(s, tipo, RESP_SIN_PEDIDO, fecha, nodo->stock);
+            } else if (!registrarEnBitacora(b, OP_CANCELAR, fecha, cantidad, texto)) {
+                responderLote(s, tipo, RESP_SIN_BITACORA, fecha, nodo->stock);
+            } else {
+                cancelarPedido(&(nodo->cabeza), texto, cantidad, nodo);
+                responderLote(s, tipo, RESP_OK, fecha, nodo->stock);
+            }
+            break;
 
-    // Casos de desbalance
-    if (balance > 1 && fecha < nodo->izquierda->fecha)
-        return rotarDerecha(nodo);
+        case SOL_REPORTE: {
+            size_t inicio = s->largoSalida;
+            reservarSalida(s, CABECERA_RESPUESTA + 12);
+            serializarLotes(s, *raiz);
+            if (s->fallo)
+                break;
+            uint64_t version = versionCambios(&cambiosLotes);
+            uint32_t lotes = (uint32_t)contarLotes(*raiz);
+            char* cabecera = s->salida + inicio;
+            cabeceraRespuesta(cabecera, tipo, RESP_OK,
+                              (uint32_t)(s->largoSalida - inicio - CABECERA_RESPUESTA));
+            memcpy(cabecera + CABECERA_RESPUESTA, &version, 8);
+            memcpy(cabecera + CABECERA_RESPUESTA + 8, &lotes, 4);
+            break;
+        }
 
-    if (balance < -1 && fecha > nodo->derecha->fecha)
-        return rotarIzquierda(nodo);
+        case SOL_CAMBIOS:
+            serializarCambios(s, *raiz, tipo, (uint64_t)(uint32_t)fecha | (uint64_t)(uint32_t)cantidad << 32);
+            break;
 
-    if (balance > 1 && fecha > nodo->izquierda->fecha) {
-        nodo->izquierda = rotarIzquierda(nodo->izquierda);
-        return rotarDerecha(nodo);
+        default: {
+            char* q = reservarSalida(s, CABECERA_RESPUESTA);
+            cabeceraRespuesta(q, tipo, RESP_INVALIDA, 0);
+        }
     }
+}
 
-    if (balance < -1 && fecha < nodo->derecha->fecha) {
-        nodo->derecha = rotarDerecha(nodo->derecha);
-        return rotarIzquierda(nodo);
+// Atender las solicitudes completas del buffer mientras haya espacio de
+// salida; una sesion con fallo ya no recibira respuestas y no se atiende
+void procesarEntrada(Sesion* s, NodoAVL** raiz, Bitacora* b) {
+    size_t pos = 0;
+    while (!s->fallo && s->leidos - pos >= CABECERA_SOLICITUD &&
+           s->largoSalida - s->enviados < LIMITE_SALIDA) {
+        size_t total = CABECERA_SOLICITUD + (unsigned char)s->entrada[pos + 1];
+        if (s->leidos - pos < total)
+            break;
+        atenderSolicitud(s, raiz, b, s->entrada + pos);
+        pos += total;
     }
+    if (pos > 0) {
+        memmove(s->entrada, s->entrada + pos, s->leidos - pos);
+        s->leidos -= pos;
+    }
+}
 
-    return nodo;
+// Hay una solicitud completa esperando en el buffer
+int solicitudCompleta(Sesion* s) {
+    return s->leidos >= CABECERA_SOLICITUD &&
+           s->leidos >= CABECERA_SOLICITUD + (size_t)(unsigned char)s->entrada[1];
 }
 
-// Encontrar el nodo con la fecha mínima (más próxima a vencer)
-NodoAVL* encontrarMinimo(NodoAVL* nodo) {
-    NodoAVL* actual = nodo;
-    while (actual->izquierda != NULL)
-        actual = actual->izquierda;
-    return actual;
+void leerSesion(Sesion* s) {
+    while (s->leidos < ENTRADA_SESION) {
+        ssize_t n = read(s->fd, s->entrada + s->leidos, ENTRADA_SESION - s->leidos);
+        if (n > 0) {
+            s->leidos += (size_t)n;
+        } else if (n == 0) {
+            s->cerrada = 1;
+            return;
+        } else {
+            if (errno != EAGAIN && errno != EINTR)
+                s->fallo = 1;
+            if (errno != EINTR)
+                return;
+        }
+    }
 }
 
-// Eliminar un nodo del árbol AVL
-NodoAVL* eliminarNodoAVL(NodoAVL* raiz, int fecha) {
-    if (raiz == NULL)
-        return raiz;
-
-    if (fecha < raiz->fecha)
-        raiz->izquierda = eliminarNodoAVL(raiz->izquierda, fecha);
-    else if (fecha > raiz->fecha)
-        raiz->derecha = eliminarNodoAVL(raiz->derecha, fecha);
-    else {
-        // Nodo encontrado: liberar cola y luego el nodo
-        liberarCola(raiz->cabeza);
-
-        if (raiz->izquierda == NULL || raiz->derecha == NULL) {
-            NodoAVL* temp = raiz->izquierda ? raiz->izquierda : raiz->derecha;
-            free(raiz);
-            return temp;
+void enviarSalida(Sesion* s) {
+    while (s->enviados < s->largoSalida) {
+        ssize_t n = write(s->fd, s->salida + s->enviados, s->largoSalida - s->enviados);
+        if (n > 0) {
+            s->enviados += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
         } else {
-            NodoAVL* temp = encontrarMinimo(raiz->derecha);
-            raiz->fecha = temp->fecha;
-            raiz->stock = temp->stock;
-            strcpy(raiz->producto, temp->producto);
-            raiz->cabeza = temp->cabeza;
-            temp->cabeza = NULL; // Evitar que se libere dos veces
-            raiz->derecha = eliminarNodoAVL(raiz->derecha, temp->fecha);
+            if (n < 0 && errno != EAGAIN)
+                s->fallo = 1;
+            return;
         }
     }
+    s->largoSalida = s->enviados = 0;
+}
 
-    if (raiz == NULL)
-        return raiz;
+void cerrarSesion(Sesion** sesiones, Sesion* s) {
+    if (s->anterior != NULL)
+        s->anterior->siguiente = s->siguiente;
+    else
+        *sesiones = s->siguiente;
+    if (s->siguiente != NULL)
+        s->siguiente->anterior = s->anterior;
+    close(s->fd);
+    free(s->salida);
+    free(s);
+}
 
-    raiz->altura = 1 + maximo(altura(raiz->izquierda), altura(raiz->derecha));
+// Aceptar todas las conexiones en espera
+void aceptarSesiones(int escucha, int ep, Sesion** sesiones) {
+    while (1) {
+        int fd = accept(escucha, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                perror("Error aceptando conexion");
+            if (errno != EINTR)
+                return;
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        Sesion* s = (Sesion*)calloc(1, sizeof(Sesion));
+        if (s == NULL) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        s->eventos = EPOLLIN;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(s);
+            continue;
+        }
+        s->siguiente = *sesiones;
+        if (*sesiones != NULL)
+            (*sesiones)->anterior = s;
+        *sesiones = s;
+    }
+}
 
-    int balance = balanceFactor(raiz);
+// Crear el socket de escucha y el epoll que lo vigila; devuelve el socket, o
+// -1 sin dejar nada abierto. socketViejo: reemplazar el de una ejecucion anterior
+int abrirEscucha(const struct sockaddr_un* direccion, int socketViejo, int* ep) {
+    int escucha = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (escucha < 0) {
+        perror("Error abriendo socket");
+        return -1;
+    }
+    if (socketViejo)
+        unlink(direccion->sun_path);
+    if (bind(escucha, (const struct sockaddr*)direccion, sizeof(*direccion)) != 0) {
+        perror("Error abriendo socket");
+        close(escucha);
+        return -1;
+    }
+    struct epoll_event evEscucha = {.events = EPOLLIN, .data.ptr = NULL};
+    *ep = -1;
+    if (listen(escucha, SOMAXCONN) != 0 || (*ep = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        epoll_ctl(*ep, EPOLL_CTL_ADD, escucha, &evEscucha) != 0) {
+        perror("Error abriendo socket");
+        if (*ep >= 0)
+            close(*ep);
+        close(escucha);
+        unlink(direccion->sun_path);
+        return -1;
+    }
+    return escucha;
+}
 
-    // Rebalancear
-    if (balance > 1 && balanceFactor(raiz->izquierda) >= 0)
-        return rotarDerecha(raiz);
+// Atender terminales en la ruta dada hasta recibir SIGINT o SIGTERM
+int ejecutarServidor(const char* ruta) {
+    struct sockaddr_un direccion = {.sun_family = AF_UNIX};
+    if (strlen(ruta) >= sizeof(direccion.sun_path)) {
+        printf("Error: Ruta de socket demasiado larga.\n");
+        return 1;
+    }
+    strcpy(direccion.sun_path, ruta);
+    // Solo se reemplaza un socket que quedo de antes, nunca otro archivo
+    struct stat info;
+    int socketViejo = lstat(ruta, &info) == 0;
+    if (socketViejo && !S_ISSOCK(info.st_mode)) {
+        printf("Error: %s ya existe y no es un socket.\n", ruta);
+        return 1;
+    }
 
-    if (balance > 1 && balanceFactor(raiz->izquierda) < 0) {
-        raiz->izquierda = rotarIzquierda(raiz->izquierda);
-        return rotarDerecha(raiz);
+    static Bitacora bitacora;
+    NodoAVL* raiz = NULL;
+    if (abrirBitacora(&bitacora, &raiz) < 0)
+        return 1;
+    iniciarVersionCambios(&cambiosLotes);
+    Compactacion compactacion = {0};
+
+    int ep;
+    int escucha = abrirEscucha(&direccion, socketViejo, &ep);
+    if (escucha < 0) {
+        cerrarBitacora(&bitacora);
+        liberarAVL(raiz);
+        liberarRegistroCambios(&cambiosLotes);
+        return 1;
     }
 
-    if (balance < -1 && balanceFactor(raiz->derecha) <= 0)
-        return rotarIzquierda(raiz);
+    struct sigaction accion = {.sa_handler = detenerServidor};
+    sigaction(SIGINT, &accion, NULL);
+    sigaction(SIGTERM, &accion, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Servidor escuchando en %s (%d lotes).\n", ruta, contarLotes(raiz));
+    fflush(stdout);
+
+    Sesion* sesiones = NULL;
+    Sesion* arrastradas = NULL;     // Con solicitudes sin atender de la vuelta anterior
+    struct epoll_event eventos[MAX_EVENTOS];
+    while (!servidorDetenido) {
+        int n = epoll_wait(ep, eventos, MAX_EVENTOS, arrastradas != NULL || compactacion.activa ? 0 : -1);
+        if (n < 0 && errno != EINTR) {
+            perror("Error esperando eventos");
+            break;
+        }
+
+        Sesion* ronda = arrastradas;
+        arrastradas = NULL;
+        for (int i = 0; i < n; i++) {
+            Sesion* s = (Sesion*)eventos[i].data.ptr;
+            if (s == NULL) {
+                aceptarSesiones(escucha, ep, &sesiones);
+                continue;
+            }
+            if (eventos[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                leerSesion(s);
+            if (!s->enRonda) {
+                s->enRonda = 1;
+                s->siguienteRonda = ronda;
+                ronda = s;
+            }
+        }
+
+        for (Sesion* s = ronda; s != NULL; s = s->siguienteRonda)
+            procesarEntrada(s, &raiz, &bitacora);
+
+        // Un solo fdatasync cubre todo lo aplicado en esta vuelta. Si falla,
+        // nada de esta vuelta se responde: el servidor se detiene sin snapshot
+        // y al reiniciar vale solo lo que quedo en disco.
+        if (!confirmarBitacora(&bitacora)) {
+            printf("Error: No se pudo confirmar la bitacora. Se detiene el servidor.\n");
+            break;
+        }
+        if (bitacora.registrosDesdeSnapshot >= SNAPSHOT_CADA)
+            guardarSnapshot(&bitacora, raiz);
+
+        while (ronda != NULL) {
+            Sesion* s = ronda;
+            ronda = s->siguienteRonda;
+            s->enRonda = 0;
+            if (!s->fallo)
+                enviarSalida(s);
+
+            int pendiente = s->largoSalida > s->enviados;
+            if (s->fallo || (s->cerrada && !pendiente && !solicitudCompleta(s))) {
+                cerrarSesion(&sesiones, s);
+                continue;
+            }
+            size_t porEnviar = s->largoSalida - s->enviados;
+            if (porEnviar < LIMITE_SALIDA && solicitudCompleta(s)) {
+                s->enRonda = 1;
+                s->siguienteRonda = arrastradas;
+                arrastradas = s;
+            }
+            int deseados = (pendiente ? EPOLLOUT : 0) |
+                           (!s->cerrada && s->leidos < ENTRADA_SESION && porEnviar < LIMITE_SALIDA
+                                ? EPOLLIN : 0);
+            if (deseados != s->eventos) {
+                struct epoll_event ev = {.events = (uint32_t)deseados, .data.ptr = s};
+                epoll_ctl(ep, EPOLL_CTL_MOD, s->fd, &ev);
+                s->eventos = deseados;
+            }
+        }
 
-    if (balance < -1 && balanceFactor(raiz->derecha) > 0) {
-        raiz->derecha = rotarDerecha(raiz->derecha);
-        return rotarIzquierda(raiz);
+        // Con las respuestas ya enviadas, un tramo de compactacion si el heap
+        // roto lo suficiente desde la ultima pasada
+        if (!compactacion.activa && requiereCompactacion(&compactacion))
+            iniciarCompactacion(&compactacion);
+        if (compactacion.activa && !compactarPaso(&raiz, &compactacion, PASO_COMPACTACION)) {
+            printf("Compactacion: %ld lotes y %ld pedidos reubicados en %d pasos.\n",
+                   compactacion.lotes, compactacion.pedidos, compactacion.pasos);
+            fflush(stdout);
+        }
     }
 
-    return raiz;
+    printf("Deteniendo servidor...\n");
+    while (sesiones != NULL)
+        cerrarSesion(&sesiones, sesiones);
+    close(ep);
+    close(escucha);
+    unlink(ruta);
+    guardarSnapshot(&bitacora, raiz);
+    cerrarBitacora(&bitacora);
+    liberarAVL(raiz);
+    liberarRegistroCambios(&cambiosLotes);
+    return bitacora.fallo ? 1 : 0;
 }
 
-// Buscar un nodo por fecha
-NodoAVL* buscarNodo(NodoAVL* raiz, int fecha) {
-    if (raiz == NULL || raiz->fecha == fecha)
-        return raiz;
+// ================= CLIENTE DE PRUEBA =================
+// Lee comandos de texto por la entrada estandar, los envia sin esperar
+// respuesta (en tuberia) e imprime las respuestas a medida que llegan:
+//   recibir FECHA STOCK PRODUCTO
+//   despachar FECHA CANTIDAD DESTINO     (FECHA 0: el lote mas proximo)
+//   eliminar FECHA
+//   cancelar FECHA CANTIDAD DESTINO
+//   reporte
+//   cambios VERSION                      (VERSION: la de un reporte o cambios anterior)
+const char* nombreSolicitud(int tipo) {
+    static const char* nombres[] = {"?", "recibir", "despachar", "eliminar", "cancelar", "reporte",
+                                    "cambios"};
+    return tipo >= SOL_RECIBIR && tipo <= SOL_CAMBIOS ? nombres[tipo] : nombres[0];
+}
+
+const char* nombreEstado(int estado) {
+    static const char* nombres[] = {"OK", "No existe el lote", "Ya existe un lote con esa fecha",
+                                    "Stock insuficiente", "No se encontro el pedido",
+                                    "Solicitud invalida",
+                                    "Version sin registro de cambios, pida un reporte",
+                                    "No se pudo registrar en la bitacora"};
+    return estado >= RESP_OK && estado <= RESP_SIN_BITACORA ? nombres[estado] : "?";
+}
 
-    if (fecha < raiz->fecha)
-        return buscarNodo(raiz->izquierda, fecha);
+// Codificar una linea de comando; devuelve los bytes escritos o 0 si no es valida
+size_t codificarSolicitud(const char* linea, char* p) {
+    char comando[16], texto[256] = "";
+    int fecha = 0, cantidad = 0, tipo;
+    unsigned long long version;
+    int campos = sscanf(linea, "%15s %d %d %255[^\n]", comando, &fecha, &cantidad, texto);
+    if (campos < 1)
+        return 0;
+    if (strcmp(comando, "recibir") == 0 && campos == 4)
+        tipo = SOL_RECIBIR;
+    else if (strcmp(comando, "despachar") == 0 && campos == 4)
+        tipo = SOL_DESPACHAR;
+    else if (strcmp(comando, "eliminar") == 0 && campos >= 2)
+        tipo = SOL_ELIMINAR;
+    else if (strcmp(comando, "cancelar") == 0 && campos == 4)
+        tipo = SOL_CANCELAR;
+    else if (strcmp(comando, "reporte") == 0)
+        tipo = SOL_REPORTE;
+    else if (strcmp(comando, "cambios") == 0 && sscanf(linea, "%*s %llu", &version) == 1) {
+        tipo = SOL_CAMBIOS;
+        fecha = (int)(uint32_t)version;
+        cantidad = (int)(uint32_t)(version >> 32);
+    } else
+        return 0;
 
-    return buscarNodo(raiz->derecha, fecha);
+    size_t largo = tipo == SOL_ELIMINAR || tipo == SOL_REPORTE || tipo == SOL_CAMBIOS ? 0 : strlen(texto);
+    if (largo > 49)
+        largo = 49;
+    int32_t f = fecha, c = cantidad;
+    p[0] = (char)tipo;
+    p[1] = (char)largo;
+    memcpy(p + 2, &f, 4);
+    memcpy(p + 6, &c, 4);
+    memcpy(p + CABECERA_SOLICITUD, texto, largo);
+    return CABECERA_SOLICITUD + largo;
 }
 
-// Recorrido In-Order (más próximo a más lejano)
-void inOrder(NodoAVL* raiz) {
-    if (raiz != NULL) {
-        inOrder(raiz->izquierda);
-        printf("Fecha: %d | Producto: %s | Stock: %d | Pedidos en cola: %d\n",
-               raiz->fecha, raiz->producto, raiz->stock, contarPedidos(raiz->cabeza));
-        inOrder(raiz->derecha);
+// Imprimir una respuesta completa
+void imprimirRespuesta(const char* p, uint32_t largo) {
+    int tipo = (unsigned char)p[0], estado = (unsigned char)p[1];
+    const char* datos = p + CABECERA_RESPUESTA;
+    if (estado != RESP_OK || largo < 4) {
+        printf("Error: %s: %s.\n", nombreSolicitud(tipo), nombreEstado(estado));
+        return;
+    }
+    if (tipo != SOL_REPORTE && tipo != SOL_CAMBIOS) {
+        int32_t fecha, stock;
+        memcpy(&fecha, datos, 4);
+        memcpy(&stock, datos + 4, 4);
+        printf("OK %s | Fecha: %d | Stock: %d\n", nombreSolicitud(tipo), fecha, stock);
+        return;
+    }
+    if (largo < 12)
+        return;
+    uint64_t version;
+    uint32_t lotes;
+    memcpy(&version, datos, 8);
+    memcpy(&lotes, datos + 8, 4);
+    if (tipo == SOL_REPORTE)
+        printf("=== REPORTE DE INVENTARIO (%u lotes, version %llu) ===\n", lotes, (unsigned long long)version);
+    else
+        printf("=== CAMBIOS (%u lotes, version %llu) ===\n", lotes, (unsigned long long)version);
+    size_t pos = 12;
+    for (uint32_t i = 0; i < lotes; i++) {
+        char marca = 0;
+        if (tipo == SOL_CAMBIOS) {
+            if (pos + 14 > largo)
+                break;
+            int cambio = (unsigned char)datos[pos++];
+            marca = cambio == CAMBIO_ALTA ? '+' : cambio == CAMBIO_BAJA ? '-' : '*';
+        }
+        if (pos + 13 > largo)
+            break;
+        int32_t valores[3];
+        memcpy(valores, datos + pos, 12);
+        int largoProducto = (unsigned char)datos[pos + 12];
+        if (marca == '-')
+            printf("- Fecha: %d\n", valores[0]);
+        else if (marca != 0)
+            printf("%c Fecha: %d | Producto: %.*s | Stock: %d | Pedidos en cola: %d\n", marca,
+                   valores[0], largoProducto, datos + pos + 13, valores[1], valores[2]);
+        else
+            printf("Fecha: %d | Producto: %.*s | Stock: %d | Pedidos en cola: %d\n",
+                   valores[0], largoProducto, datos + pos + 13, valores[1], valores[2]);
+        pos += 13 + (size_t)largoProducto;
     }
 }
 
-// Liberar todo el árbol AVL
-void liberarAVL(NodoAVL* raiz) {
-    if (raiz != NULL) {
-        liberarAVL(raiz->izquierda);
-        liberarAVL(raiz->derecha);
-        liberarCola(raiz->cabeza);
-        free(raiz);
+// Conectarse al servidor y atender la entrada estandar hasta agotarla
+int ejecutarCliente(const char* ruta) {
+    struct sockaddr_un direccion = {.sun_family = AF_UNIX};
+    if (strlen(ruta) >= sizeof(direccion.sun_path)) {
+        printf("Error: Ruta de socket demasiado larga.\n");
+        return 1;
+    }
+    strcpy(direccion.sun_path, ruta);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&direccion, sizeof(direccion)) != 0) {
+        perror("Error conectando al servidor");
+        return 1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    static char linea[4096];
+    size_t largoLinea = 0;
+    char* envio = (char*)malloc(LIMITE_SALIDA + 2 * sizeof(linea));
+    size_t porEnviar = 0, enviados = 0;
+    size_t capacidad = 1 << 16, recibidos = 0;
+    char* respuestas = (char*)malloc(capacidad);
+    long enVuelo = 0, solicitudes = 0;
+    int finEntrada = 0, escrituraCerrada = 0, servidorCerro = 0, sinMemoria = envio == NULL || respuestas == NULL;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    while (!sinMemoria && (!finEntrada || enVuelo > 0 || enviados < porEnviar)) {
+        struct pollfd fds[2] = {
+            {.fd = 0, .events = !finEntrada && porEnviar < LIMITE_SALIDA ? POLLIN : 0},
+            {.fd = fd, .events = POLLIN | (enviados < porEnviar ? POLLOUT : 0)},
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // Entrada estandar -> solicitudes codificadas
+        if (!finEntrada && (fds[0].revents & (POLLIN | POLLHUP))) {
+            ssize_t n = read(0, linea + largoLinea, sizeof(linea) - 1 - largoLinea);
+            if (n <= 0) {
+                finEntrada = 1;
+                n = 0;
+                if (largoLinea > 0)
+                    linea[largoLinea++] = '\n';
+            }
+            largoLinea += (size_t)n;
+            size_t inicioLinea = 0;
+            for (size_t i = 0; i < largoLinea; i++) {
+                if (linea[i] != '\n')
+                    continue;
+                linea[i] = 0;
+                size_t bytes = codificarSolicitud(linea + inicioLinea, envio + porEnviar);
+                if (bytes > 0) {
+                    porEnviar += bytes;
+                    enVuelo++;
+                    solicitudes++;
+                } else if (linea[inicioLinea] != 0) {
+                    fprintf(stderr, "Error: Comando no valido: %s\n", linea + inicioLinea);
+                }
+                inicioLinea = i + 1;
+            }
+            memmove(linea, linea + inicioLinea, largoLinea - inicioLinea);
+            largoLinea -= inicioLinea;
+            if (largoLinea == sizeof(linea) - 1) {
+                fprintf(stderr, "Error: Linea demasiado larga.\n");
+                largoLinea = 0;
+            }
+        }
+
+        // Solicitudes pendientes -> socket
+        while (enviados < porEnviar) {
+            ssize_t n = write(fd, envio + enviados, porEnviar - enviados);
+            if (n <= 0)
+                break;
+            enviados += (size_t)n;
+        }
+        if (enviados == porEnviar)
+            porEnviar = enviados = 0;
+        if (finEntrada && porEnviar == 0 && !escrituraCerrada) {
+            shutdown(fd, SHUT_WR);
+            escrituraCerrada = 1;
+        }
+
+        // Socket -> respuestas completas
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            while (1) {
+                if (recibidos == capacidad) {
+                    char* mayor = (char*)realloc(respuestas, capacidad * 2);
+                    if (mayor == NULL) {
+                        sinMemoria = 1;
+                        break;
+                    }
+                    respuestas = mayor;
+                    capacidad *= 2;
+                }
+                ssize_t n = read(fd, respuestas + recibidos, capacidad - recibidos);
+                if (n <= 0) {
+                    if (n == 0 || (errno != EAGAIN && errno != EINTR))
+                        servidorCerro = 1;
+                    break;
+                }
+                recibidos += (size_t)n;
+            }
+            if (sinMemoria)
+                break;
+            size_t pos = 0;
+            while (recibidos - pos >= CABECERA_RESPUESTA) {
+                uint32_t largo;
+                memcpy(&largo, respuestas + pos + 2, 4);
+                if (recibidos - pos < CABECERA_RESPUESTA + largo)
+                    break;
+                imprimirRespuesta(respuestas + pos, largo);
+                pos += CABECERA_RESPUESTA + largo;
+                enVuelo--;
+            }
+            memmove(respuestas, respuestas + pos, recibidos - pos);
+            recibidos -= pos;
+            if (servidorCerro) {
+                if (enVuelo > 0)
+                    printf("Error: El servidor cerro la conexion.\n");
+                break;
+            }
+        }
     }
+
+    if (sinMemoria)
+        fprintf(stderr, "Error: Sin memoria para las respuestas del servidor.\n");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double segundos = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%ld solicitudes en %.3f s (%.0f por segundo)\n", solicitudes, segundos,
+            segundos > 0 ? solicitudes / segundos : 0.0);
+    free(envio);
+    free(respuestas);
+    close(fd);
+    return sinMemoria ? 1 : 0;
 }
 
 // ================= MENÚ PRINCIPAL =================
@@ -691,15 +2513,53 @@ void mostrarMenu() {
     printf("4. Cancelar Pedido Especifico\n");
     printf("5. Reporte de Estado (Recorrido In-Order)\n");
     printf("6. Salir\n");
+    printf("7. Estadisticas del Motor\n");
+    printf("8. Exportar Inventario (CSV/Ancho fijo/Binario)\n");
+    printf("9. Alertas de Vencimiento\n");
+    printf("10. Reporte de Cierre (stock y pedidos por destino)\n");
+    printf("11. Memoria y Compactacion\n");
+    printf("12. Reporte de Cambios (desde el ultimo reporte)\n");
     printf("Seleccione una opcion: ");
 }
 
-int main() {
+#ifndef SIN_MAIN
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--servidor") == 0)
+        return ejecutarServidor(argv[2]);
+    if (argc == 3 && strcmp(argv[1], "--cliente") == 0)
+        return ejecutarCliente(argv[2]);
+    if (argc != 1) {
+        printf("Uso: %s [--servidor RUTA_SOCKET | --cliente RUTA_SOCKET]\n", argv[0]);
+        return 1;
+    }
+
     NodoAVL* raiz = NULL;
     int opcion, fecha, stock, cantidad;
     char producto[50], destino[50];
+    static Bitacora bitacora;
+
+    activarEstadisticasDesdeEntorno();
+    long reaplicadas = abrirBitacora(&bitacora, &raiz);
+    if (reaplicadas > 0)
+        printf("Estado recuperado: %d lotes, %ld operaciones reaplicadas.\n",
+               contarLotes(raiz), reaplicadas);
+    PoolRecorrido pool;
+    iniciarPoolRecorrido(&pool, hilosDisponibles());
+    static Calendario calendario;
+    reconstruirCalendario(&calendario, raiz, diaDeHoy());
+    calendarioActivo = &calendario;
+    iniciarVersionCambios(&cambiosLotes);
+    uint64_t versionReportada = versionCambios(&cambiosLotes);
 
     do {
+        // Confirmar el lote pendiente antes de esperar al operador
+        if (!confirmarBitacora(&bitacora))
+            printf("Error: No se pudo confirmar la bitacora; la ultima operacion no es durable.\n");
+        if (bitacora.registrosDesdeSnapshot >= SNAPSHOT_CADA)
+            guardarSnapshot(&bitacora, raiz);
+        // Si cambio el dia, correr la rueda
+        avanzarCalendario(&calendario, raiz, diaDeHoy());
+
         mostrarMenu();
         scanf("%d", &opcion);
         getchar(); // Limpiar buffer
@@ -715,8 +2575,12 @@ int main() {
                 printf("Ingrese stock inicial: ");
                 scanf("%d", &stock);
 
-                if (buscarNodo(raiz, fecha) != NULL) {
+                if (!fechaValida(fecha)) {
+                    printf("Error: Fecha invalida.\n");
+                } else if (buscarNodo(raiz, fecha) != NULL) {
                     printf("Error: Ya existe un producto con esa fecha.\n");
+                } else if (!registrarEnBitacora(&bitacora, OP_INSERTAR, fecha, stock, producto)) {
+                    printf("Error: No se pudo registrar la operacion en la bitacora.\n");
                 } else {
                     raiz = insertarAVL(raiz, fecha, producto, stock);
                     printf("Producto registrado exitosamente.\n");
@@ -729,7 +2593,7 @@ int main() {
                     break;
                 }
                 // Buscar la fecha más próxima (mínima)
-                NodoAVL* masProximo = encontrarMinimo(raiz);
+                NodoAVL* masProximo = minimoParaModificar(&raiz);
                 printf("Producto mas proximo a vencer: %s (Fecha: %d, Stock: %d)\n",
                        masProximo->producto, masProximo->fecha, masProximo->stock);
 
@@ -742,9 +2606,10 @@ int main() {
 
                 if (cantidad > masProximo->stock) {
                     printf("Error: Stock insuficiente.\n");
+                } else if (!registrarEnBitacora(&bitacora, OP_ENCOLAR, masProximo->fecha, cantidad, destino)) {
+                    printf("Error: No se pudo registrar la operacion en la bitacora.\n");
                 } else {
-                    encolar(&(masProximo->cabeza), destino, cantidad);
-                    masProximo->stock -= cantidad;
+                    registrarPedido(masProximo, destino, cantidad);
                     printf("Pedido registrado exitosamente.\n");
                 }
                 break;
@@ -754,6 +2619,8 @@ int main() {
                 scanf("%d", &fecha);
                 if (buscarNodo(raiz, fecha) == NULL) {
                     printf("Error: No existe un producto con esa fecha.\n");
+                } else if (!registrarEnBitacora(&bitacora, OP_ELIMINAR, fecha, 0, NULL)) {
+                    printf("Error: No se pudo registrar la operacion en la bitacora.\n");
                 } else {
                     raiz = eliminarNodoAVL(raiz, fecha);
                     printf("Producto y sus pedidos eliminados exitosamente.\n");
@@ -763,7 +2630,7 @@ int main() {
             case 4:
                 printf("Ingrese fecha del producto (AAAAMMDD): ");
                 scanf("%d", &fecha);
-                NodoAVL* nodoCancelar = buscarNodo(raiz, fecha);
+                NodoAVL* nodoCancelar = buscarParaModificar(&raiz, fecha);
                 if (nodoCancelar == NULL) {
                     printf("Error: No existe un producto con esa fecha.\n");
                 } else {
@@ -774,20 +2641,27 @@ int main() {
                     printf("Ingrese cantidad del pedido a cancelar: ");
                     scanf("%d", &cantidad);
 
-                    if (cancelarPedido(&(nodoCancelar->cabeza), destino, cantidad, nodoCancelar)) {
-                        printf("Pedido cancelado exitosamente. Stock restaurado.\n");
-                    } else {
+                    if (buscarPedido(nodoCancelar->cabeza, destino, cantidad) == NULL) {
                         printf("Error: No se encontro el pedido especificado.\n");
+                    } else if (!registrarEnBitacora(&bitacora, OP_CANCELAR, fecha, cantidad, destino)) {
+                        printf("Error: No se pudo registrar la operacion en la bitacora.\n");
+                    } else {
+                        cancelarPedido(&(nodoCancelar->cabeza), destino, cantidad, nodoCancelar);
+                        printf("Pedido cancelado exitosamente. Stock restaurado.\n");
                     }
                 }
                 break;
 
             case 5:
+                versionReportada = versionCambios(&cambiosLotes);
                 if (raiz == NULL) {
                     printf("No hay productos en inventario.\n");
                 } else {
+                    // El reporte recorre una version fija, no el arbol vivo
+                    NodoAVL* version = abrirVersion(raiz);
                     printf("\n=== REPORTE DE INVENTARIO ===\n");
-                    inOrder(raiz);
+                    inOrder(version);
+                    cerrarVersion(version);
                 }
                 break;
 
@@ -795,13 +2669,111 @@ int main() {
                 printf("Saliendo del sistema...\n");
                 break;
 
+            case 7:
+                if (ESTADISTICAS_ACTIVAS) {
+                    NodoAVL* version = abrirVersion(raiz);
+                    imprimirEstadisticas(stdout, version);
+                    cerrarVersion(version);
+                } else if (activarEstadisticas()) {
+                    printf("Recoleccion de estadisticas activada desde ahora.\n");
+                } else {
+                    printf("Este ejecutable se compilo sin estadisticas.\n");
+                }
+                break;
+
+            case 8: {
+                char ruta[256];
+                int formato;
+                printf("Archivo de salida (- para pantalla): ");
+                fgets(ruta, sizeof(ruta), stdin);
+                ruta[strcspn(ruta, "\n")] = 0;
+                printf("Formato (1. CSV, 2. Ancho fijo, 3. Binario): ");
+                scanf("%d", &formato);
+                if (formato < EXPORTAR_CSV || formato > EXPORTAR_BINARIO) {
+                    printf("Formato no valido.\n");
+                    break;
+                }
+                NodoAVL* version = abrirVersion(raiz);
+                long lotes = exportarInventario(version, ruta, formato, &pool);
+                cerrarVersion(version);
+                if (lotes < 0)
+                    printf("Error: No se pudo exportar el inventario.\n");
+                else
+                    printf("Inventario exportado: %ld lotes.\n", lotes);
+                break;
+            }
+
+            case 9: {
+                int dias = 7;
+                printf("Dias a revisar (Enter = 7): ");
+                char linea[32];
+                if (fgets(linea, sizeof(linea), stdin) != NULL && linea[0] != '\n')
+                    dias = atoi(linea);
+                if (dias <= 0) {
+                    printf("Error: Numero de dias invalido.\n");
+                    break;
+                }
+                NodoAVL* proximo = proximoAVencer(&calendario);
+                printf("\n=== ALERTAS DE VENCIMIENTO (hoy: %d) ===\n", fechaDesdeOrdinal(calendario.diaBase));
+                if (proximo != NULL)
+                    printf("Proximo a vencer: %s (Fecha: %d)\n", proximo->producto, proximo->fecha);
+                if (alertasVencimiento(stdout, &calendario, dias) == 0)
+                    printf("Ningun lote vence en los proximos %d dias.\n", dias);
+                printf("Vencidos: %ld | Fuera del horizonte: %ld | Fecha invalida: %ld\n",
+                       calendario.vencidos, calendario.lejanos, calendario.invalidos);
+                break;
+            }
+
+            case 10: {
+                NodoAVL* version = abrirVersion(raiz);
+                imprimirReporteCierre(stdout, &pool, version);
+                cerrarVersion(version);
+                break;
+            }
+
+            case 11: {
+                imprimirMemoria(stdout);
+                printf("Compactar ahora? (1. Si, 2. No): ");
+                int compactar;
+                scanf("%d", &compactar);
+                if (compactar != 1)
+                    break;
+                static Compactacion compactacion;
+                iniciarCompactacion(&compactacion);
+                while (compactarPaso(&raiz, &compactacion, PASO_COMPACTACION))
+                    ;
+                printf("Compactacion: %ld lotes y %ld pedidos reubicados en %d pasos.\n",
+                       compactacion.lotes, compactacion.pedidos, compactacion.pasos);
+                imprimirMemoria(stdout);
+                break;
+            }
+
+            case 12: {
+                uint64_t version;
+                printf("\n=== CAMBIOS DESDE EL ULTIMO REPORTE ===\n");
+                long cambios = reporteCambios(stdout, raiz, versionReportada, &version);
+                if (cambios < 0) {
+                    printf("El registro de cambios ya no cubre el ultimo reporte. Use la opcion 5.\n");
+                } else {
+                    if (cambios == 0)
+                        printf("Sin cambios.\n");
+                    versionReportada = version;
+                }
+                break;
+            }
+
             default:
                 printf("Opcion no valida.\n");
         }
     } while (opcion != 6);
 
-    // Liberar toda la memoria antes de salir
+    // Dejar el estado en un snapshot limpio y liberar toda la memoria
+    guardarSnapshot(&bitacora, raiz);
+    cerrarBitacora(&bitacora);
+    detenerPoolRecorrido(&pool);
     liberarAVL(raiz);
+    liberarRegistroCambios(&cambiosLotes);
 
     return 0;
 }
+#endif
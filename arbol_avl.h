@@ -0,0 +1,320 @@
+// Nucleo AVL intrusivo comun a los indices de los sistemas. No es un tipo
+// generico con punteros a funcion: se especializa en tiempo de compilacion
+// para cada tipo de nodo, asi que comparar claves y actualizar alturas queda
+// en linea. Cada programa define los parametros y luego incluye el archivo;
+// se puede incluir varias veces (una por tipo de nodo).
+//
+// Obligatorios:
+//   ARBOL_PREFIJO      prefijo de las funciones generadas (indice -> indiceInsertar)
+//   ARBOL_NODO         tipo del nodo
+//   ARBOL_CLAVE_TIPO   tipo de la clave
+//   ARBOL_CLAVE(n)     clave del nodo n
+//   ARBOL_IZQ, ARBOL_DER, ARBOL_ALTURA   nombres de los campos del nodo
+// Opcionales:
+//   ARBOL_MENOR(a, b)        orden de las claves (por defecto a < b)
+//   ARBOL_PROPIO(n)          nodo listo para modificar (copia por version);
+//                            por defecto el mismo nodo
+//   ARBOL_CREAR(clave, datos)     nodo nuevo para insertar (quien asigna memoria)
+//   ARBOL_LIBERAR(n)              liberar un nodo eliminado y su contenido
+//   ARBOL_VISITA()                un nodo visitado en un descenso
+//   ARBOL_AL_ROTAR()              una rotacion simple
+//   ARBOL_AL_BALANCEAR(caso)      un reequilibrio: caso es LL, RR, LR o RL
+//   ARBOL_PROFUNDIDAD(p)          nivel donde quedo un nodo insertado
+// Sin ARBOL_CREAR no se genera la insercion; sin ARBOL_LIBERAR, la eliminacion.
+
+#if !defined(ARBOL_PREFIJO) || !defined(ARBOL_NODO) || !defined(ARBOL_CLAVE_TIPO) || \
+    !defined(ARBOL_CLAVE) || !defined(ARBOL_IZQ) || !defined(ARBOL_DER) || !defined(ARBOL_ALTURA)
+#error "arbol_avl.h: faltan parametros del arbol"
+#endif
+
+#ifndef ARBOL_MENOR
+#define ARBOL_MENOR(a, b) ((a) < (b))
+#endif
+#ifndef ARBOL_PROPIO
+#define ARBOL_PROPIO(n) (n)
+#endif
+#ifndef ARBOL_VISITA
+#define ARBOL_VISITA() ((void)0)
+#endif
+#ifndef ARBOL_AL_ROTAR
+#define ARBOL_AL_ROTAR() ((void)0)
+#endif
+#ifndef ARBOL_AL_BALANCEAR
+#define ARBOL_AL_BALANCEAR(caso) ((void)0)
+#endif
+#ifndef ARBOL_PROFUNDIDAD
+#define ARBOL_PROFUNDIDAD(p) ((void)(p))
+#endif
+
+#define ARBOL_UNIR_(a, b) a##b
+#define ARBOL_UNIR(a, b) ARBOL_UNIR_(a, b)
+#define ARBOL_FN(nombre) ARBOL_UNIR(ARBOL_PREFIJO, nombre)
+
+// Altura de un subarbol (0 si esta vacio)
+static inline int ARBOL_FN(Altura)(const ARBOL_NODO* n) {
+    return n ? n->ARBOL_ALTURA : 0;
+}
+
+static inline void ARBOL_FN(ActualizarAltura)(ARBOL_NODO* n) {
+    int izq = ARBOL_FN(Altura)(n->ARBOL_IZQ);
+    int der = ARBOL_FN(Altura)(n->ARBOL_DER);
+    n->ARBOL_ALTURA = 1 + (izq > der ? izq : der);
+}
+
+static inline ARBOL_NODO* ARBOL_FN(RotarDerecha)(ARBOL_NODO* y) {
+    y = ARBOL_PROPIO(y);
+    ARBOL_NODO* x = ARBOL_PROPIO(y->ARBOL_IZQ);
+    y->ARBOL_IZQ = x->ARBOL_DER;
+    x->ARBOL_DER = y;
+    ARBOL_FN(ActualizarAltura)(y);
+    ARBOL_FN(ActualizarAltura)(x);
+    ARBOL_AL_ROTAR();
+    return x;
+}
+
+static inline ARBOL_NODO* ARBOL_FN(RotarIzquierda)(ARBOL_NODO* x) {
+    x = ARBOL_PROPIO(x);
+    ARBOL_NODO* y = ARBOL_PROPIO(x->ARBOL_DER);
+    x->ARBOL_DER = y->ARBOL_IZQ;
+    y->ARBOL_IZQ = x;
+    ARBOL_FN(ActualizarAltura)(x);
+    ARBOL_FN(ActualizarAltura)(y);
+    ARBOL_AL_ROTAR();
+    return y;
+}
+
+// Restaurar la condicion AVL en un nodo propio cuyos hijos ya estan
+// balanceados (tras insertar, eliminar o unir)
+static inline ARBOL_NODO* ARBOL_FN(Balancear)(ARBOL_NODO* n) {
+    ARBOL_FN(ActualizarAltura)(n);
+    int balance = ARBOL_FN(Altura)(n->ARBOL_IZQ) - ARBOL_FN(Altura)(n->ARBOL_DER);
+    if (balance > 1) {
+        ARBOL_NODO* hijo = n->ARBOL_IZQ;
+        if (ARBOL_FN(Altura)(hijo->ARBOL_IZQ) < ARBOL_FN(Altura)(hijo->ARBOL_DER)) {
+            ARBOL_AL_BALANCEAR(LR);
+            n->ARBOL_IZQ = ARBOL_FN(RotarIzquierda)(hijo);
+        } else {
+            ARBOL_AL_BALANCEAR(LL);
+        }
+        return ARBOL_FN(RotarDerecha)(n);
+    }
+    if (balance < -1) {
+        ARBOL_NODO* hijo = n->ARBOL_DER;
+        if (ARBOL_FN(Altura)(hijo->ARBOL_DER) < ARBOL_FN(Altura)(hijo->ARBOL_IZQ)) {
+            ARBOL_AL_BALANCEAR(RL);
+            n->ARBOL_DER = ARBOL_FN(RotarDerecha)(hijo);
+        } else {
+            ARBOL_AL_BALANCEAR(RR);
+        }
+        return ARBOL_FN(RotarIzquierda)(n);
+    }
+    return n;
+}
+
+static inline ARBOL_NODO* ARBOL_FN(Buscar)(ARBOL_NODO* n, ARBOL_CLAVE_TIPO clave) {
+    while (n != NULL) {
+        ARBOL_VISITA();
+        if (ARBOL_MENOR(clave, ARBOL_CLAVE(n)))
+            n = n->ARBOL_IZQ;
+        else if (ARBOL_MENOR(ARBOL_CLAVE(n), clave))
+            n = n->ARBOL_DER;
+        else
+            return n;
+    }
+    return NULL;
+}
+
+static inline ARBOL_NODO* ARBOL_FN(Minimo)(ARBOL_NODO* n) {
+    while (n != NULL && n->ARBOL_IZQ != NULL)
+        n = n->ARBOL_IZQ;
+    return n;
+}
+
+static inline ARBOL_NODO* ARBOL_FN(Maximo)(ARBOL_NODO* n) {
+    while (n != NULL && n->ARBOL_DER != NULL)
+        n = n->ARBOL_DER;
+    return n;
+}
+
+// Minimo listo para modificar: hace propio todo el camino desde *enlace
+static inline ARBOL_NODO* ARBOL_FN(MinimoPropio)(ARBOL_NODO** enlace) {
+    if (*enlace == NULL)
+        return NULL;
+    while (1) {
+        *enlace = ARBOL_PROPIO(*enlace);
+        if ((*enlace)->ARBOL_IZQ == NULL)
+            return *enlace;
+        enlace = &(*enlace)->ARBOL_IZQ;
+    }
+}
+
+// Buscar para modificar: hace propio el camino recorrido
+static inline ARBOL_NODO* ARBOL_FN(BuscarPropio)(ARBOL_NODO** enlace, ARBOL_CLAVE_TIPO clave) {
+    while (*enlace != NULL) {
+        ARBOL_VISITA();
+        *enlace = ARBOL_PROPIO(*enlace);
+        ARBOL_NODO* n = *enlace;
+        if (ARBOL_MENOR(clave, ARBOL_CLAVE(n)))
+            enlace = &n->ARBOL_IZQ;
+        else if (ARBOL_MENOR(ARBOL_CLAVE(n), clave))
+            enlace = &n->ARBOL_DER;
+        else
+            return n;
+    }
+    return NULL;
+}
+
+#ifdef ARBOL_CREAR
+static inline ARBOL_NODO* ARBOL_FN(InsertarRec)(ARBOL_NODO* n, ARBOL_CLAVE_TIPO clave, const void* datos,
+                                                ARBOL_NODO** existente, int profundidad) {
+    if (n == NULL) {
+        ARBOL_PROFUNDIDAD(profundidad);
+        return ARBOL_CREAR(clave, datos);
+    }
+    ARBOL_VISITA();
+    n = ARBOL_PROPIO(n);
+    if (ARBOL_MENOR(clave, ARBOL_CLAVE(n))) {
+        n->ARBOL_IZQ = ARBOL_FN(InsertarRec)(n->ARBOL_IZQ, clave, datos, existente, profundidad + 1);
+    } else if (ARBOL_MENOR(ARBOL_CLAVE(n), clave)) {
+        n->ARBOL_DER = ARBOL_FN(InsertarRec)(n->ARBOL_DER, clave, datos, existente, profundidad + 1);
+    } else {
+        *existente = n;
+        return n;
+    }
+    return ARBOL_FN(Balancear)(n);
+}
+
+// Insertar un nodo nuevo (creado con ARBOL_CREAR a partir de datos). Si la
+// clave ya existe no se crea nada y el nodo existente queda en *existente.
+static inline ARBOL_NODO* ARBOL_FN(Insertar)(ARBOL_NODO* raiz, ARBOL_CLAVE_TIPO clave, const void* datos,
+                                             ARBOL_NODO** existente) {
+    *existente = NULL;
+    return ARBOL_FN(InsertarRec)(raiz, clave, datos, existente, 1);
+}
+#endif
+
+// ---------- Union y division (reenlazando, sin copiar nodos) ----------
+// Unir izq + pivote + der, con todo izq < pivote < todo der: O(|h1 - h2|)
+static inline ARBOL_NODO* ARBOL_FN(UnirConPivote)(ARBOL_NODO* izq, ARBOL_NODO* pivote, ARBOL_NODO* der) {
+    int hi = ARBOL_FN(Altura)(izq);
+    int hd = ARBOL_FN(Altura)(der);
+    if (hi > hd + 1) {
+        izq = ARBOL_PROPIO(izq);
+        izq->ARBOL_DER = ARBOL_FN(UnirConPivote)(izq->ARBOL_DER, pivote, der);
+        return ARBOL_FN(Balancear)(izq);
+    }
+    if (hd > hi + 1) {
+        der = ARBOL_PROPIO(der);
+        der->ARBOL_IZQ = ARBOL_FN(UnirConPivote)(izq, pivote, der->ARBOL_IZQ);
+        return ARBOL_FN(Balancear)(der);
+    }
+    pivote = ARBOL_PROPIO(pivote);
+    pivote->ARBOL_IZQ = izq;
+    pivote->ARBOL_DER = der;
+    ARBOL_FN(ActualizarAltura)(pivote);
+    return pivote;
+}
+
+// Desprender el nodo de menor clave; queda suelto en *minimo
+static inline ARBOL_NODO* ARBOL_FN(ExtraerMinimo)(ARBOL_NODO* n, ARBOL_NODO** minimo) {
+    n = ARBOL_PROPIO(n);
+    if (n->ARBOL_IZQ == NULL) {
+        ARBOL_NODO* der = n->ARBOL_DER;
+        n->ARBOL_DER = NULL;
+        n->ARBOL_ALTURA = 1;
+        *minimo = n;
+        return der;
+    }
+    n->ARBOL_IZQ = ARBOL_FN(ExtraerMinimo)(n->ARBOL_IZQ, minimo);
+    return ARBOL_FN(Balancear)(n);
+}
+
+// Concatenar dos arboles con todo izq < todo der
+static inline ARBOL_NODO* ARBOL_FN(Concatenar)(ARBOL_NODO* izq, ARBOL_NODO* der) {
+    if (izq == NULL)
+        return der;
+    if (der == NULL)
+        return izq;
+    ARBOL_NODO* pivote;
+    der = ARBOL_FN(ExtraerMinimo)(der, &pivote);
+    return ARBOL_FN(UnirConPivote)(izq, pivote, der);
+}
+
+// Partir en claves < clave (*menores) y > clave (*mayores): O(log n).
+// Si la clave existe, su nodo se devuelve suelto; si no, NULL.
+static inline ARBOL_NODO* ARBOL_FN(Partir)(ARBOL_NODO* n, ARBOL_CLAVE_TIPO clave, ARBOL_NODO** menores,
+                                           ARBOL_NODO** mayores) {
+    if (n == NULL) {
+        *menores = NULL;
+        *mayores = NULL;
+        return NULL;
+    }
+    n = ARBOL_PROPIO(n);
+    ARBOL_NODO* izq = n->ARBOL_IZQ;
+    ARBOL_NODO* der = n->ARBOL_DER;
+    ARBOL_NODO* encontrado;
+    ARBOL_NODO* medio;
+    if (ARBOL_MENOR(clave, ARBOL_CLAVE(n))) {
+        encontrado = ARBOL_FN(Partir)(izq, clave, menores, &medio);
+        *mayores = ARBOL_FN(UnirConPivote)(medio, n, der);
+    } else if (ARBOL_MENOR(ARBOL_CLAVE(n), clave)) {
+        encontrado = ARBOL_FN(Partir)(der, clave, &medio, mayores);
+        *menores = ARBOL_FN(UnirConPivote)(izq, n, medio);
+    } else {
+        *menores = izq;
+        *mayores = der;
+        n->ARBOL_IZQ = NULL;
+        n->ARBOL_DER = NULL;
+        n->ARBOL_ALTURA = 1;
+        encontrado = n;
+    }
+    return encontrado;
+}
+
+#ifdef ARBOL_LIBERAR
+// Eliminar la clave si existe. Un nodo con dos hijos se reemplaza por su
+// sucesor reenlazado, sin copiar datos: cada registro que sigue en el arbol
+// conserva su direccion.
+static inline ARBOL_NODO* ARBOL_FN(Eliminar)(ARBOL_NODO* n, ARBOL_CLAVE_TIPO clave) {
+    if (n == NULL)
+        return NULL;
+    ARBOL_VISITA();
+    n = ARBOL_PROPIO(n);
+    if (ARBOL_MENOR(clave, ARBOL_CLAVE(n))) {
+        n->ARBOL_IZQ = ARBOL_FN(Eliminar)(n->ARBOL_IZQ, clave);
+    } else if (ARBOL_MENOR(ARBOL_CLAVE(n), clave)) {
+        n->ARBOL_DER = ARBOL_FN(Eliminar)(n->ARBOL_DER, clave);
+    } else if (n->ARBOL_IZQ == NULL || n->ARBOL_DER == NULL) {
+        ARBOL_NODO* hijo = n->ARBOL_IZQ ? n->ARBOL_IZQ : n->ARBOL_DER;
+        ARBOL_LIBERAR(n);
+        return hijo;
+    } else {
+        ARBOL_NODO* sucesor;
+        ARBOL_NODO* der = ARBOL_FN(ExtraerMinimo)(n->ARBOL_DER, &sucesor);
+        sucesor->ARBOL_IZQ = n->ARBOL_IZQ;
+        sucesor->ARBOL_DER = der;
+        ARBOL_LIBERAR(n);
+        return ARBOL_FN(Balancear)(sucesor);
+    }
+    return ARBOL_FN(Balancear)(n);
+}
+#endif
+
+#undef ARBOL_FN
+#undef ARBOL_UNIR
+#undef ARBOL_UNIR_
+#undef ARBOL_PREFIJO
+#undef ARBOL_NODO
+#undef ARBOL_CLAVE_TIPO
+#undef ARBOL_CLAVE
+#undef ARBOL_IZQ
+#undef ARBOL_DER
+#undef ARBOL_ALTURA
+#undef ARBOL_MENOR
+#undef ARBOL_PROPIO
+#undef ARBOL_CREAR
+#undef ARBOL_LIBERAR
+#undef ARBOL_VISITA
+#undef ARBOL_AL_ROTAR
+#undef ARBOL_AL_BALANCEAR
+#undef ARBOL_PROFUNDIDAD
@@ -0,0 +1,76 @@
+// Benchmark de "Tiquetes. Avion": rafagas de venta hasta el limite de
+// sobreventa seguidas de abordaje y listados, para vuelos pequeños
+// repetidos y para un solo vuelo muy grande.
+//
+// Compilar desde la raiz del repositorio:
+//   gcc -O2 -o bench_avion benchmarks/bench_avion.c
+// Uso:
+//   ./bench_avion [capacidad_vuelo_grande]
+#define SIN_MAIN
+#include "../Tiquetes. Avion"
+#include "bench_comun.h"
+
+static int capacidadGrande = 1000000;
+static const char* generosBench[3] = {"Femenino", "Masculino", "No Binario"};
+
+// Vender, abordar y listar un vuelo completo; luego dejar el sistema en cero
+static void correrVuelo(int capacidad, Medicion* mVenta, Medicion* mAbordaje,
+                        Medicion* mAbordados, Medicion* mNoAbordados) {
+    char apellido[50];
+    capacidad_maxima = capacidad;
+
+    int limite = limite_sobreventa();
+    for (int i = 0; i < limite; i++) {
+        snprintf(apellido, sizeof(apellido), "Apellido%d", i);
+        uint64_t t = ahoraNs();
+        agregar_pasajero(generosBench[i % 3], apellido);
+        registrarMuestra(mVenta, ahoraNs() - t);
+    }
+
+    uint64_t t = ahoraNs();
+    iniciar_abordaje();
+    registrarMuestra(mAbordaje, ahoraNs() - t);
+
+    t = ahoraNs();
+    ver_abordados();
+    registrarMuestra(mAbordados, ahoraNs() - t);
+
+    t = ahoraNs();
+    ver_no_abordados();
+    registrarMuestra(mNoAbordados, ahoraNs() - t);
+
+    liberar_lista();
+    tiquetes_vendidos = 0;
+    abordaje_iniciado = 0;
+    capacidad_maxima = 0;
+}
+
+static void correrVuelos(int vuelos, int capacidad) {
+    Medicion mVenta, mAbordaje, mAbordados, mNoAbordados;
+    iniciarMedicion(&mVenta, "venta");
+    iniciarMedicion(&mAbordaje, "abordaje");
+    iniciarMedicion(&mAbordados, "abordados");
+    iniciarMedicion(&mNoAbordados, "no_abordados");
+
+    for (int v = 0; v < vuelos; v++)
+        correrVuelo(capacidad, &mVenta, &mAbordaje, &mAbordados, &mNoAbordados);
+
+    reportarMedicion(&mVenta);
+    reportarMedicion(&mAbordaje);
+    reportarMedicion(&mAbordados);
+    reportarMedicion(&mNoAbordados);
+}
+
+static void escenarioVuelosPequenos(void) { correrVuelos(2000, 180); }
+static void escenarioVueloGrande(void) { correrVuelos(1, capacidadGrande); }
+
+int main(int argc, char* argv[]) {
+    char titulo[96];
+    if (argc > 1)
+        capacidadGrande = atoi(argv[1]);
+    prepararSalida();
+    ejecutarEscenario("2000 vuelos de 180 sillas", escenarioVuelosPequenos);
+    snprintf(titulo, sizeof(titulo), "1 vuelo de %d sillas", capacidadGrande);
+    ejecutarEscenario(titulo, escenarioVueloGrande);
+    return 0;
+}
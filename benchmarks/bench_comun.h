@@ -0,0 +1,135 @@
+// Utilidades comunes de los benchmarks: reloj, registro de latencias con
+// percentiles, memoria residente maxima y ejecucion aislada de escenarios.
+#ifndef BENCH_COMUN_H
+#define BENCH_COMUN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Los sistemas imprimen mientras trabajan; stdout se envia a /dev/null y
+// los resultados del benchmark salen por este flujo.
+static FILE* salidaBench = NULL;
+
+static inline void prepararSalida(void) {
+    fflush(stdout);
+    int copia = dup(STDOUT_FILENO);
+    salidaBench = fdopen(copia, "w");
+    setvbuf(salidaBench, NULL, _IOLBF, 0);
+    int nulo = open("/dev/null", O_WRONLY);
+    dup2(nulo, STDOUT_FILENO);
+    close(nulo);
+}
+
+static inline uint64_t ahoraNs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+static inline double segundosDesde(struct timespec inicio) {
+    struct timespec fin;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    return (fin.tv_sec - inicio.tv_sec) + (fin.tv_nsec - inicio.tv_nsec) / 1e9;
+}
+
+// Latencias de un tipo de operacion
+typedef struct Medicion {
+    const char* nombre;
+    uint64_t* muestras;
+    size_t cantidad;
+    size_t capacidad;
+    uint64_t totalNs;
+} Medicion;
+
+static inline void iniciarMedicion(Medicion* m, const char* nombre) {
+    m->nombre = nombre;
+    m->muestras = NULL;
+    m->cantidad = 0;
+    m->capacidad = 0;
+    m->totalNs = 0;
+}
+
+static inline void registrarMuestra(Medicion* m, uint64_t ns) {
+    if (m->cantidad == m->capacidad) {
+        m->capacidad = m->capacidad ? m->capacidad * 2 : 4096;
+        m->muestras = (uint64_t*)realloc(m->muestras, m->capacidad * sizeof(uint64_t));
+    }
+    m->muestras[m->cantidad++] = ns;
+    m->totalNs += ns;
+}
+
+static inline int compararMuestras(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static inline uint64_t percentil(const Medicion* m, double p) {
+    if (m->cantidad == 0)
+        return 0;
+    size_t i = (size_t)(p * (double)(m->cantidad - 1));
+    return m->muestras[i];
+}
+
+// Operaciones reportadas en el escenario en curso (para el rendimiento de pared)
+static size_t operacionesEscenario = 0;
+
+static inline void imprimirEncabezado(const char* escenario) {
+    fprintf(salidaBench, "\n== %s ==\n", escenario);
+    fprintf(salidaBench, "%-14s %10s %14s %10s %10s %10s\n",
+            "Operacion", "Ops", "media(ns)", "p50(ns)", "p99(ns)", "p999(ns)");
+}
+
+// Imprimir y liberar una medicion (ordena las muestras en sitio). La media
+// es la latencia de la region medida, no un rendimiento: el rendimiento del
+// escenario se reporta con su tiempo de pared.
+static inline void reportarMedicion(Medicion* m) {
+    if (m->cantidad == 0)
+        return;
+    qsort(m->muestras, m->cantidad, sizeof(uint64_t), compararMuestras);
+    operacionesEscenario += m->cantidad;
+    fprintf(salidaBench, "%-14s %10zu %14.0f %10llu %10llu %10llu\n",
+            m->nombre, m->cantidad, (double)m->totalNs / (double)m->cantidad,
+            (unsigned long long)percentil(m, 0.50),
+            (unsigned long long)percentil(m, 0.99),
+            (unsigned long long)percentil(m, 0.999));
+    free(m->muestras);
+    m->muestras = NULL;
+}
+
+static inline long memoriaMaximaKB(void) {
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    return uso.ru_maxrss;
+}
+
+// Ejecutar un escenario en un proceso hijo: el estado global de cada sistema
+// arranca limpio y la memoria residente maxima es la del escenario solo. Es
+// una por escenario, no por tipo de operacion: en una mezcla las operaciones
+// se intercalan sobre el mismo estado y su memoria no se puede separar.
+static inline void ejecutarEscenario(const char* nombre, void (*escenario)(void)) {
+    fflush(salidaBench);
+    pid_t hijo = fork();
+    if (hijo == 0) {
+        imprimirEncabezado(nombre);
+        uint64_t inicio = ahoraNs();
+        escenario();
+        double segundos = (ahoraNs() - inicio) / 1e9;
+        // El tiempo de pared incluye la preparacion del escenario y todo lo
+        // que queda fuera de las regiones medidas
+        fprintf(salidaBench, "Tiempo de pared: %.3f s | %zu ops medidas | %.0f ops/s de pared\n",
+                segundos, operacionesEscenario, segundos > 0 ? operacionesEscenario / segundos : 0.0);
+        fprintf(salidaBench, "RSS maximo: %ld KB\n", memoriaMaximaKB());
+        fflush(salidaBench);
+        _exit(0);
+    }
+    waitpid(hijo, NULL, 0);
+}
+
+#endif
@@ -0,0 +1,287 @@
+// Benchmark de Sistemalogistico.c con mezclas de recepcion, despacho,
+// cancelacion y baja de lotes. Cada mezcla corre solo en memoria y con la
+// bitacora activa, para medir el costo de la durabilidad.
+//
+// Compilar desde la raiz del repositorio:
+//   gcc -O2 -pthread -o bench_logistico benchmarks/bench_logistico.c
+// Uso:
+//   ./bench_logistico [operaciones]
+#define SIN_MAIN
+#include "../Sistemalogistico.c"
+#include "bench_comun.h"
+
+typedef struct Mezcla {
+    const char* nombre;
+    int recepcion;      // Porcentajes; el resto son bajas de lotes
+    int despacho;
+    int cancelacion;
+} Mezcla;
+
+static int numOperaciones = 500000;
+static const Mezcla* mezclaActual;
+static int conBitacora;
+static const char* destinosBench[4] = {"Timbiqui", "Juanchaco", "Tumaco", "Guapi"};
+
+// Borrar los archivos de la bitacora y el directorio temporal que los tenia
+static void borrarDirectorioBitacora(const char* directorio) {
+    unlink(ARCHIVO_BITACORA);
+    unlink(ARCHIVO_SNAPSHOT);
+    if (chdir("/tmp") != 0 || rmdir(directorio) != 0)
+        perror("Error borrando el directorio temporal");
+}
+
+static void correrMezcla(void) {
+    static Bitacora bitacora;
+    NodoAVL* raiz = NULL;
+    OrdenDespacho* despachados = (OrdenDespacho*)malloc(sizeof(OrdenDespacho) * numOperaciones);
+    int numDespachados = 0;
+    Medicion mRecepcion, mDespacho, mCancelacion, mBaja;
+    char plantilla[] = "/tmp/bench_logisticoXXXXXX";
+    int i;
+
+    if (conBitacora) {
+        if (mkdtemp(plantilla) == NULL || chdir(plantilla) != 0) {
+            perror("Error creando directorio temporal");
+            free(despachados);
+            return;
+        }
+        if (abrirBitacora(&bitacora, &raiz) < 0) {
+            perror("Error abriendo la bitacora");
+            borrarDirectorioBitacora(plantilla);
+            free(despachados);
+            return;
+        }
+    } else {
+        desactivarBitacora(&bitacora);
+    }
+
+    iniciarMedicion(&mRecepcion, "recepcion");
+    iniciarMedicion(&mDespacho, "despacho");
+    iniciarMedicion(&mCancelacion, "cancelacion");
+    iniciarMedicion(&mBaja, "baja");
+    srand(11);
+
+    // Inventario inicial
+    for (int i = 0; i < 10000; i++) {
+        int fecha = 20250101 + rand() % 1000000;
+        if (buscarNodo(raiz, fecha) == NULL)
+            raiz = insertarAVL(raiz, fecha, "Carga", 1000);
+    }
+
+    // Una operacion que no queda en la bitacora no se cuenta: la mezcla se corta
+    for (i = 0; i < numOperaciones; i++) {
+        int dado = rand() % 100;
+        int fecha = 20250101 + rand() % 1000000;
+        uint64_t t = ahoraNs();
+
+        if (dado < mezclaActual->recepcion) {
+            if (buscarNodo(raiz, fecha) == NULL) {
+                if (!registrarEnBitacora(&bitacora, OP_INSERTAR, fecha, 1000, "Carga"))
+                    break;
+                raiz = insertarAVL(raiz, fecha, "Carga", 1000);
+            }
+            registrarMuestra(&mRecepcion, ahoraNs() - t);
+        } else if (dado < mezclaActual->recepcion + mezclaActual->despacho) {
+            // Igual que el menu: se despacha del lote mas proximo a vencer
+            NodoAVL* nodo = minimoParaModificar(&raiz);
+            int cantidad = 1 + rand() % 5;
+            const char* destino = destinosBench[i % 4];
+            if (nodo != NULL && cantidad <= nodo->stock) {
+                if (!registrarEnBitacora(&bitacora, OP_ENCOLAR, nodo->fecha, cantidad, destino))
+                    break;
+                registrarPedido(nodo, destino, cantidad);
+                OrdenDespacho* o = &despachados[numDespachados++];
+                o->fecha = nodo->fecha;
+                o->cantidad = cantidad;
+                strcpy(o->destino, destino);
+            }
+            registrarMuestra(&mDespacho, ahoraNs() - t);
+        } else if (dado < mezclaActual->recepcion + mezclaActual->despacho + mezclaActual->cancelacion) {
+            if (numDespachados > 0) {
+                int k = rand() % numDespachados;
+                OrdenDespacho o = despachados[k];
+                despachados[k] = despachados[--numDespachados];
+                NodoAVL* nodo = buscarParaModificar(&raiz, o.fecha);
+                if (nodo != NULL) {
+                    if (!registrarEnBitacora(&bitacora, OP_CANCELAR, o.fecha, o.cantidad, o.destino))
+                        break;
+                    cancelarPedido(&(nodo->cabeza), o.destino, o.cantidad, nodo);
+                }
+            }
+            registrarMuestra(&mCancelacion, ahoraNs() - t);
+        } else {
+            // Baja del lote mas proximo a vencer (o de uno al azar si no hay)
+            NodoAVL* minimo = raiz ? lotesMinimo(raiz) : NULL;
+            if (minimo != NULL) {
+                fecha = minimo->fecha;
+                if (!registrarEnBitacora(&bitacora, OP_ELIMINAR, fecha, 0, NULL))
+                    break;
+                raiz = eliminarNodoAVL(raiz, fecha);
+            }
+            registrarMuestra(&mBaja, ahoraNs() - t);
+        }
+    }
+    if (i < numOperaciones || !confirmarBitacora(&bitacora)) {
+        fprintf(salidaBench, "Error: La bitacora fallo tras %d operaciones; se descarta la mezcla.\n", i);
+        if (conBitacora) {
+            cerrarBitacora(&bitacora);
+            borrarDirectorioBitacora(plantilla);
+        }
+        liberarAVL(raiz);
+        free(despachados);
+        return;
+    }
+
+    reportarMedicion(&mRecepcion);
+    reportarMedicion(&mDespacho);
+    reportarMedicion(&mCancelacion);
+    reportarMedicion(&mBaja);
+    if (conBitacora)
+        fprintf(salidaBench, "fdatasync: %ld (%.1f operaciones por confirmacion)\n",
+                bitacora.confirmaciones,
+                bitacora.confirmaciones ? (double)numOperaciones / bitacora.confirmaciones : 0.0);
+
+    // Recuperacion: reaplicar la bitacora completa desde cero
+    if (conBitacora) {
+        NodoAVL* recuperado = NULL;
+        static Bitacora otra;
+        cerrarBitacora(&bitacora);
+        uint64_t t = ahoraNs();
+        long reaplicadas = abrirBitacora(&otra, &recuperado);
+        double segundos = (ahoraNs() - t) / 1e9;
+        fprintf(salidaBench, "Recuperacion: %ld operaciones en %.3f s (%.0f ops/s)\n",
+                reaplicadas, segundos, segundos > 0 ? reaplicadas / segundos : 0.0);
+        cerrarBitacora(&otra);
+        liberarAVL(recuperado);
+        borrarDirectorioBitacora(plantilla);
+    }
+
+    liberarAVL(raiz);
+    free(despachados);
+}
+
+// Recorrer el inventario completo como lo haria un reporte
+static long recorrerInventario(NodoAVL* nodo) {
+    if (nodo == NULL)
+        return 0;
+    long total = nodo->stock;
+    for (Pedido* p = nodo->cabeza; p != NULL; p = p->siguiente)
+        total += p->cantidad;
+    return total + recorrerInventario(nodo->izquierda) + recorrerInventario(nodo->derecha);
+}
+
+// Rotacion larga de lotes y pedidos; recorrido antes y despues de compactar
+static void escenarioCompactacion(void) {
+    NodoAVL* raiz = NULL;
+    Medicion mAntes, mCompactar, mDespues;
+    Compactacion compactacion = {0};
+    long suma = 0;
+
+    srand(23);
+    for (int i = 0; i < numOperaciones; i++) {
+        int fecha = 20250101 + rand() % 400000;
+        NodoAVL* nodo = buscarParaModificar(&raiz, fecha);
+        if (nodo == NULL)
+            raiz = insertarAVL(raiz, fecha, "Carga", 1000);
+        else if (rand() % 4 == 0)
+            raiz = eliminarNodoAVL(raiz, fecha);
+        else
+            encolar(&(nodo->cabeza), &(nodo->ultimo), destinosBench[i % 4], 1);
+    }
+    iniciarMedicion(&mAntes, "recorrer");
+    iniciarMedicion(&mCompactar, "compactar");
+    iniciarMedicion(&mDespues, "recorrer_comp");
+
+    for (int i = 0; i < 5; i++) {
+        uint64_t t = ahoraNs();
+        suma += recorrerInventario(raiz);
+        registrarMuestra(&mAntes, ahoraNs() - t);
+    }
+    imprimirMemoria(salidaBench);
+    uint64_t t = ahoraNs();
+    iniciarCompactacion(&compactacion);
+    while (compactarPaso(&raiz, &compactacion, PASO_COMPACTACION))
+        ;
+    registrarMuestra(&mCompactar, ahoraNs() - t);
+    imprimirMemoria(salidaBench);
+    for (int i = 0; i < 5; i++) {
+        t = ahoraNs();
+        suma -= recorrerInventario(raiz);
+        registrarMuestra(&mDespues, ahoraNs() - t);
+    }
+
+    reportarMedicion(&mAntes);
+    reportarMedicion(&mCompactar);
+    reportarMedicion(&mDespues);
+    if (suma != 0)
+        fprintf(salidaBench, "Error: la compactacion cambio el inventario.\n");
+    liberarAVL(raiz);
+}
+
+// Monitoreo por sondeo: entre sondeos cambia una fraccion pequeña del
+// inventario; reporte completo contra reporte de cambios desde el anterior
+static void escenarioCambios(void) {
+    NodoAVL* raiz = NULL;
+    Medicion mReporte, mCambios;
+    uint64_t version;
+    long cambios = 0;
+
+    srand(29);
+    iniciarVersionCambios(&cambiosLotes);
+    for (int i = 0; i < numOperaciones / 2; i++)
+        raiz = insertarAVL(raiz, 20250101 + i, "Carga", 1000);
+    iniciarMedicion(&mReporte, "reporte");
+    iniciarMedicion(&mCambios, "cambios");
+    uint64_t desde = versionCambios(&cambiosLotes);
+
+    for (int sondeo = 0; sondeo < 20; sondeo++) {
+        for (int i = 0; i < 1000; i++) {
+            int fecha = 20250101 + rand() % (numOperaciones / 2);
+            NodoAVL* nodo = buscarParaModificar(&raiz, fecha);
+            if (nodo == NULL)
+                raiz = insertarAVL(raiz, fecha, "Carga", 1000);
+            else if (rand() % 8 == 0)
+                raiz = eliminarNodoAVL(raiz, fecha);
+            else if (nodo->stock > 0)
+                registrarPedido(nodo, destinosBench[i % 4], 1);
+        }
+        uint64_t t = ahoraNs();
+        inOrder(raiz);
+        registrarMuestra(&mReporte, ahoraNs() - t);
+        t = ahoraNs();
+        cambios += reporteCambios(stdout, raiz, desde, &version);
+        registrarMuestra(&mCambios, ahoraNs() - t);
+        desde = version;
+    }
+
+    fprintf(salidaBench, "Lotes cambiados por sondeo: %ld\n", cambios / 20);
+    reportarMedicion(&mReporte);
+    reportarMedicion(&mCambios);
+    liberarAVL(raiz);
+}
+
+int main(int argc, char* argv[]) {
+    static const Mezcla mezclas[] = {
+        {"Recepcion", 100, 0, 0},
+        {"Despacho (20/70/8/2)", 20, 70, 8},
+        {"Cancelaciones (10/45/40/5)", 10, 45, 40},
+    };
+    char titulo[128];
+
+    if (argc > 1)
+        numOperaciones = atoi(argv[1]);
+    prepararSalida();
+    fprintf(salidaBench, "Operaciones por mezcla: %d\n", numOperaciones);
+
+    for (size_t i = 0; i < sizeof(mezclas) / sizeof(mezclas[0]); i++) {
+        mezclaActual = &mezclas[i];
+        for (conBitacora = 0; conBitacora <= 1; conBitacora++) {
+            snprintf(titulo, sizeof(titulo), "%s - %s", mezclas[i].nombre,
+                     conBitacora ? "con bitacora" : "en memoria");
+            ejecutarEscenario(titulo, correrMezcla);
+        }
+    }
+    ejecutarEscenario("Rotacion del heap y compactacion", escenarioCompactacion);
+    ejecutarEscenario("Sondeo de monitoreo: reporte completo y de cambios", escenarioCambios);
+    return 0;
+}
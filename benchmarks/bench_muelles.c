@@ -0,0 +1,97 @@
+// Benchmark del motor de despacho multi-muelle de Sistemalogistico.c.
+// Mide el rendimiento (ordenes por segundo) con 1..N muelles sobre el mismo
+// inventario y la misma carga, y reporta cuantas ordenes se robaron y
+// cuantos cambios anoto el despacho en el registro de cambios (cambios.h),
+// que queda dentro de la medicion. Se corre en memoria y con la bitacora
+// activa (group commit compartido por los muelles), en un directorio temporal.
+//
+// Compilar desde la raiz del repositorio:
+//   gcc -O2 -pthread -o bench_muelles benchmarks/bench_muelles.c
+// Uso:
+//   ./bench_muelles [max_muelles] [ordenes] [lotes]
+#define SIN_MAIN
+#include "../Sistemalogistico.c"
+#include "bench_comun.h"
+
+static void correrMuelles(int maxMuelles, int ordenes, int lotes, int conBitacora) {
+    static Bitacora bitacora;
+    const char* destinos[4] = {"Timbiqui", "Juanchaco", "Tumaco", "Guapi"};
+
+    printf("\n%s\n", conBitacora ? "Con bitacora" : "En memoria");
+    printf("%-8s %-12s %-14s %-10s %-10s %-10s %-10s\n", "Muelles", "Segundos", "Ordenes/s", "Speedup", "Robadas",
+           "Cambios", "fdatasync");
+
+    double base = 0;
+    for (int muelles = 1, siguiente; muelles <= maxMuelles; muelles = siguiente) {
+        NodoAVL* raiz = NULL;
+        MotorDespacho motor;
+        srand(42);
+
+        char plantilla[] = "/tmp/bench_muellesXXXXXX";
+        if (conBitacora) {
+            if (mkdtemp(plantilla) == NULL || chdir(plantilla) != 0 || abrirBitacora(&bitacora, &raiz) < 0) {
+                perror("Error preparando la bitacora");
+                return;
+            }
+        } else {
+            desactivarBitacora(&bitacora);
+        }
+
+        for (int i = 0; i < lotes; i++)
+            raiz = insertarAVL(raiz, 20250101 + i, "Carga", ordenes);
+        iniciarVersionCambios(&cambiosLotes);
+        uint64_t versionInicial = versionCambios(&cambiosLotes);
+
+        // Carga sesgada: la mitad de las ordenes va al muelle 0 para que
+        // los demas tengan que robarle trabajo
+        iniciarMotor(&motor, &raiz, &bitacora, muelles);
+        for (int i = 0; i < ordenes; i++) {
+            int muelle = (i % 2 == 0) ? 0 : rand() % muelles;
+            enviarOrden(&motor, muelle, 20250101 + rand() % lotes, destinos[i % 4], 1 + rand() % 5);
+        }
+
+        struct timespec inicio;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        arrancarMuelles(&motor);
+        esperarMotor(&motor);
+        double segundos = segundosDesde(inicio);
+
+        long robadas = 0;
+        for (int i = 0; i < muelles; i++)
+            robadas += motor.muelles[i].robadas;
+        detenerMotor(&motor);
+
+        if (muelles == 1)
+            base = segundos;
+        printf("%-8d %-12.3f %-14.0f %-10.2f %-10ld %-10llu %-10ld\n",
+               muelles, segundos, ordenes / segundos, base / segundos, robadas,
+               (unsigned long long)(versionCambios(&cambiosLotes) - versionInicial), bitacora.confirmaciones);
+
+        liberarAVL(raiz);
+        if (conBitacora) {
+            cerrarBitacora(&bitacora);
+            unlink(ARCHIVO_BITACORA);
+            unlink(ARCHIVO_SNAPSHOT);
+            if (chdir("/tmp") != 0 || rmdir(plantilla) != 0)
+                perror("Error borrando el directorio temporal");
+        }
+
+        // Duplicar los muelles, midiendo siempre el maximo pedido
+        siguiente = muelles * 2;
+        if (muelles < maxMuelles && siguiente > maxMuelles)
+            siguiente = maxMuelles;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int maxMuelles = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int ordenes = argc > 2 ? atoi(argv[2]) : 1000000;
+    int lotes = argc > 3 ? atoi(argv[3]) : 10000;
+
+    if (maxMuelles < 1)
+        maxMuelles = 1;
+    printf("Ordenes: %d | Lotes: %d\n", ordenes, lotes);
+    correrMuelles(maxMuelles, ordenes, lotes, 0);
+    correrMuelles(maxMuelles, ordenes, lotes, 1);
+    return 0;
+}
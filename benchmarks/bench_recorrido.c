@@ -0,0 +1,64 @@
+// Benchmark de los recorridos paralelos (recorrido.h) sobre el indice de
+// pasajeros de sistematiquetes.c: resumen por destino y tarifa y exportacion
+// CSV completa con 1..N hilos sobre el mismo manifiesto.
+//
+// Compilar desde la raiz del repositorio:
+//   gcc -O2 -pthread -o bench_recorrido benchmarks/bench_recorrido.c
+// Uso:
+//   ./bench_recorrido [max_hilos] [pasajeros]
+#define SIN_MAIN
+#include "../sistematiquetes.c"
+#include "bench_comun.h"
+
+int main(int argc, char* argv[]) {
+    int maxHilos = argc > 1 ? atoi(argv[1]) : hilosDisponibles();
+    int pasajeros = argc > 2 ? atoi(argv[2]) : 2000000;
+    const char* destinos[4] = {"Timbiqui", "Juanchaco", "Tumaco", "Guapi"};
+    const char* tarifas[2] = {"Ida", "Ida y Regreso"};
+    Pasajero* raiz = NULL;
+
+    if (maxHilos < 1)
+        maxHilos = 1;
+    // Documentos distintos en orden disperso: i * constante impar es una biyeccion modulo 2^31
+    srand(42);
+    for (int i = 0; i < pasajeros; i++)
+        raiz = insertar(raiz, (int)(((uint32_t)i * 2654435761u) & 0x7fffffff),
+                        (char*)destinos[rand() % 4], (char*)tarifas[rand() % 2]);
+
+    printf("Pasajeros: %d\n", contarPasajeros(raiz));
+    printf("%-6s %-12s %-10s %-12s %-10s %-10s\n", "Hilos", "Resumen(s)", "Speedup", "Exportar(s)",
+           "Speedup", "Grupos");
+
+    double baseResumen = 0, baseExportar = 0;
+    for (int hilos = 1, siguiente; hilos <= maxHilos; hilos = siguiente) {
+        PoolRecorrido pool;
+        ParcialRecorrido total;
+        iniciarPoolRecorrido(&pool, hilos);
+
+        struct timespec inicio;
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        resumirManifiesto(&pool, raiz, &total);
+        double resumen = segundosDesde(inicio);
+        size_t grupos = total.tabla.usadas;
+        liberarParcial(&total);
+
+        clock_gettime(CLOCK_MONOTONIC, &inicio);
+        exportarManifiesto(raiz, "/dev/null", EXPORTAR_CSV, &pool);
+        double exportar = segundosDesde(inicio);
+        detenerPoolRecorrido(&pool);
+
+        if (hilos == 1) {
+            baseResumen = resumen;
+            baseExportar = exportar;
+        }
+        printf("%-6d %-12.3f %-10.2f %-12.3f %-10.2f %-10zu\n", hilos, resumen, baseResumen / resumen,
+               exportar, baseExportar / exportar, grupos);
+
+        // Duplicar los hilos, midiendo siempre el maximo pedido
+        siguiente = hilos * 2;
+        if (hilos < maxHilos && siguiente > maxHilos)
+            siguiente = maxHilos;
+    }
+    liberarArbol(raiz);
+    return 0;
+}
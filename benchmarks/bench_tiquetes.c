@@ -0,0 +1,213 @@
+// Benchmark del indice de pasajeros de sistematiquetes.c con flujos de
+// documentos ordenados, aleatorios y adversarios (zigzag). Los flujos
+// ordenados y adversarios ejercitan las rotaciones del indice balanceado.
+//
+// Compilar desde la raiz del repositorio:
+//   gcc -O2 -pthread -o bench_tiquetes benchmarks/bench_tiquetes.c
+// Uso:
+//   ./bench_tiquetes [pasajeros]
+#define SIN_MAIN
+#include "../sistematiquetes.c"
+#include "bench_comun.h"
+
+static int numPasajeros = 20000;
+static const char* destinosBench[4] = {"Timbiqui", "Juanchaco", "Tumaco", "Guapi"};
+
+// Generadores de documentos
+static void generarOrdenado(int* docs, int n) {
+    for (int i = 0; i < n; i++)
+        docs[i] = 10000000 + i;
+}
+
+static void generarAleatorio(int* docs, int n) {
+    generarOrdenado(docs, n);
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = docs[i];
+        docs[i] = docs[j];
+        docs[j] = t;
+    }
+}
+
+// Alterna extremos (menor, mayor, siguiente menor...): cada insercion
+// desciende por todo el camino en zigzag
+static void generarAdversario(int* docs, int n) {
+    int bajo = 10000000, alto = 10000000 + n - 1;
+    for (int i = 0; i < n; i++)
+        docs[i] = (i % 2 == 0) ? bajo++ : alto--;
+}
+
+static void correrFlujo(void (*generar)(int*, int)) {
+    int n = numPasajeros;
+    int* docs = (int*)malloc(sizeof(int) * n);
+    Pasajero* raiz = NULL;
+    Medicion mInsertar, mDuplicado, mContar, mInorden, mExportar, mEliminar;
+    char tipo[20] = "Ida";
+
+    srand(7);
+    generar(docs, n);
+    iniciarMedicion(&mInsertar, "insertar");
+    iniciarMedicion(&mDuplicado, "duplicado");
+    iniciarMedicion(&mContar, "contar");
+    iniciarMedicion(&mInorden, "inorden");
+    iniciarMedicion(&mExportar, "exportar_csv");
+    iniciarMedicion(&mEliminar, "eliminar");
+
+    for (int i = 0; i < n; i++) {
+        uint64_t t = ahoraNs();
+        raiz = insertar(raiz, docs[i], (char*)destinosBench[i % 4], tipo);
+        registrarMuestra(&mInsertar, ahoraNs() - t);
+    }
+    for (int i = 0; i < n / 10; i++) {
+        uint64_t t = ahoraNs();
+        raiz = insertar(raiz, docs[rand() % n], (char*)destinosBench[0], tipo);
+        registrarMuestra(&mDuplicado, ahoraNs() - t);
+    }
+    for (int i = 0; i < 20; i++) {
+        uint64_t t = ahoraNs();
+        contarPasajeros(raiz);
+        registrarMuestra(&mContar, ahoraNs() - t);
+    }
+    for (int i = 0; i < 5; i++) {
+        uint64_t t = ahoraNs();
+        inorden(raiz);
+        registrarMuestra(&mInorden, ahoraNs() - t);
+    }
+    for (int i = 0; i < 5; i++) {
+        uint64_t t = ahoraNs();
+        exportarManifiesto(raiz, "/dev/null", EXPORTAR_CSV, NULL);
+        registrarMuestra(&mExportar, ahoraNs() - t);
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t t = ahoraNs();
+        raiz = eliminar(raiz, docs[i]);
+        registrarMuestra(&mEliminar, ahoraNs() - t);
+    }
+
+    reportarMedicion(&mInsertar);
+    reportarMedicion(&mDuplicado);
+    reportarMedicion(&mContar);
+    reportarMedicion(&mInorden);
+    reportarMedicion(&mExportar);
+    reportarMedicion(&mEliminar);
+    liberarArbol(raiz);
+    free(docs);
+}
+
+// Dividir un manifiesto por rango y volver a unirlo; fusionar dos manifiestos
+// que se traslapan en la mitad de sus documentos
+static void escenarioManifiestos(void) {
+    int n = numPasajeros;
+    int* docs = (int*)malloc(sizeof(int) * n);
+    Pasajero *a = NULL, *b = NULL;
+    Medicion mDividir, mUnir, mFusionar;
+    char tipo[20] = "Ida";
+
+    srand(13);
+    generarAleatorio(docs, n);
+    for (int i = 0; i < n; i++)
+        a = insertar(a, docs[i], (char*)destinosBench[i % 4], tipo);
+    for (int i = 0; i < n; i++)
+        b = insertar(b, docs[i] + n / 2, (char*)destinosBench[i % 4], tipo);
+
+    iniciarMedicion(&mDividir, "dividir");
+    iniciarMedicion(&mUnir, "unir");
+    iniciarMedicion(&mFusionar, "fusionar");
+
+    for (int i = 0; i < 1000; i++) {
+        Pasajero *menores, *desde, *duplicados;
+        int numDuplicados;
+        uint64_t t = ahoraNs();
+        dividirManifiesto(a, 10000000 + rand() % n, &menores, &desde);
+        registrarMuestra(&mDividir, ahoraNs() - t);
+        t = ahoraNs();
+        a = unirManifiestos(menores, desde, &duplicados, &numDuplicados);
+        registrarMuestra(&mUnir, ahoraNs() - t);
+    }
+
+    Pasajero* duplicados;
+    int numDuplicados;
+    uint64_t t = ahoraNs();
+    a = unirManifiestos(a, b, &duplicados, &numDuplicados);
+    registrarMuestra(&mFusionar, ahoraNs() - t);
+
+    reportarMedicion(&mDividir);
+    reportarMedicion(&mUnir);
+    reportarMedicion(&mFusionar);
+    fprintf(salidaBench, "Duplicados detectados al fusionar: %d\n", numDuplicados);
+    while (duplicados != NULL) {
+        Pasajero* siguiente = duplicados->der;
+        liberarPasajero(duplicados);
+        duplicados = siguiente;
+    }
+    liberarArbol(a);
+    free(docs);
+}
+
+// Lote nocturno de reservas y cancelaciones (un 10% del indice, la mitad
+// documentos existentes): llamadas individuales contra aplicarLote
+static void escenarioLote(void) {
+    int n = numPasajeros, m = numPasajeros / 10;
+    int* docs = (int*)malloc(sizeof(int) * n);
+    Mutacion* lote = (Mutacion*)malloc(sizeof(Mutacion) * m);
+    Pasajero *a = NULL, *b = NULL;
+    Medicion mIndividual, mLote;
+    char tipo[20] = "Ida";
+
+    srand(17);
+    generarAleatorio(docs, n);
+    for (int i = 0; i < n; i += 2) {
+        a = insertar(a, docs[i], (char*)destinosBench[i % 4], tipo);
+        b = insertar(b, docs[i], (char*)destinosBench[i % 4], tipo);
+    }
+    for (int i = 0; i < m; i++) {
+        lote[i].tipo = rand() % 2 ? MUTACION_RESERVA : MUTACION_CANCELACION;
+        lote[i].documento = docs[rand() % n];
+        strcpy(lote[i].destino, destinosBench[i % 4]);
+        strcpy(lote[i].tipo_pasaje, tipo);
+    }
+
+    iniciarMedicion(&mIndividual, "lote_uno_a_uno");
+    iniciarMedicion(&mLote, "lote_ordenado");
+    // Sin E/S en ninguno de los dos caminos: uno a uno va directo al nucleo
+    // del indice, sin los mensajes del menu
+    uint64_t t = ahoraNs();
+    for (int i = 0; i < m; i++) {
+        if (lote[i].tipo == MUTACION_RESERVA) {
+            DatosPasajero datos = {lote[i].destino, lote[i].tipo_pasaje};
+            Pasajero* existente;
+            a = indiceInsertar(a, lote[i].documento, &datos, &existente);
+        } else {
+            a = indiceEliminar(a, lote[i].documento);
+        }
+    }
+    registrarMuestra(&mIndividual, ahoraNs() - t);
+    t = ahoraNs();
+    b = aplicarLote(b, lote, m);
+    registrarMuestra(&mLote, ahoraNs() - t);
+
+    reportarMedicion(&mIndividual);
+    reportarMedicion(&mLote);
+    fprintf(salidaBench, "Mutaciones por lote: %d\n", m);
+    liberarArbol(a);
+    liberarArbol(b);
+    free(lote);
+    free(docs);
+}
+
+static void escenarioOrdenado(void) { correrFlujo(generarOrdenado); }
+static void escenarioAleatorio(void) { correrFlujo(generarAleatorio); }
+static void escenarioAdversario(void) { correrFlujo(generarAdversario); }
+
+int main(int argc, char* argv[]) {
+    if (argc > 1)
+        numPasajeros = atoi(argv[1]);
+    prepararSalida();
+    fprintf(salidaBench, "Pasajeros por flujo: %d\n", numPasajeros);
+    ejecutarEscenario("Documentos aleatorios", escenarioAleatorio);
+    ejecutarEscenario("Documentos ordenados", escenarioOrdenado);
+    ejecutarEscenario("Documentos adversarios (zigzag)", escenarioAdversario);
+    ejecutarEscenario("Division y union de manifiestos", escenarioManifiestos);
+    ejecutarEscenario("Lote nocturno de reservas y cancelaciones", escenarioLote);
+    return 0;
+}
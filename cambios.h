@@ -0,0 +1,212 @@
+// Registro de cambios para reportes incrementales. Cada alta, baja o
+// modificacion de un registro (lote, pasajero) sube la version y anota su
+// clave. Un reporte recuerda la version con que se hizo; el siguiente pide
+// los cambios desde ahi y recibe un cambio neto por clave, en orden de
+// clave, con costo proporcional a lo que cambio y no al tamaño del arbol.
+//
+// El registro esta repartido en franjas por clave, cada una con su candado,
+// para que los muelles que despachan lotes distintos no se esperen entre si;
+// la version es un contador atomico que se toma con la franja tomada, asi
+// que cada franja queda en orden de version. Guarda a lo sumo 'limite'
+// anotaciones: una franja llena descarta su mitad mas vieja, y las versiones
+// anteriores solo admiten reporte completo. Las versiones arrancan en una
+// base tomada del reloj, asi que una version de una ejecucion anterior
+// tampoco se confunde con una de la actual.
+#ifndef CAMBIOS_H
+#define CAMBIOS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define CAMBIO_ALTA 1
+#define CAMBIO_BAJA 2
+#define CAMBIO_MODIFICACION 3
+#define FRANJAS_CAMBIOS 16      // Divide a FRANJAS_LOTE: un lote del motor cae siempre en la misma
+
+typedef struct AnotacionCambio {
+    uint64_t version;
+    int clave;
+    int tipo;
+} AnotacionCambio;
+
+typedef struct FranjaCambios {
+    pthread_mutex_t candado;
+    AnotacionCambio* anotaciones;   // En orden de version
+    size_t usadas, capacidad;
+    uint64_t versionMinima;         // La franja esta completa desde esta version
+} FranjaCambios;
+
+typedef struct RegistroCambios {
+    FranjaCambios franjas[FRANJAS_CAMBIOS];
+    size_t limite;
+    _Atomic uint64_t version;       // Version del ultimo cambio anotado
+} RegistroCambios;
+
+typedef struct CambioNeto {
+    int clave;
+    int tipo;
+} CambioNeto;
+
+#define REGISTRO_CAMBIOS(limite) \
+    {{[0 ... FRANJAS_CAMBIOS - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0}}, (limite), 0}
+
+static inline FranjaCambios* franjaCambios(RegistroCambios* r, int clave) {
+    return &r->franjas[(unsigned)clave % FRANJAS_CAMBIOS];
+}
+
+static inline void tomarFranjasCambios(RegistroCambios* r) {
+    for (int i = 0; i < FRANJAS_CAMBIOS; i++)
+        pthread_mutex_lock(&r->franjas[i].candado);
+}
+
+static inline void soltarFranjasCambios(RegistroCambios* r) {
+    for (int i = FRANJAS_CAMBIOS - 1; i >= 0; i--)
+        pthread_mutex_unlock(&r->franjas[i].candado);
+}
+
+// Fijar la base de versiones de esta ejecucion; lo anotado hasta aqui (la
+// carga del estado guardado) queda como punto de partida
+static inline void iniciarVersionCambios(RegistroCambios* r) {
+    tomarFranjasCambios(r);
+    uint64_t base = (uint64_t)time(NULL) << 24;
+    atomic_store(&r->version, base);
+    for (int i = 0; i < FRANJAS_CAMBIOS; i++) {
+        r->franjas[i].versionMinima = base;
+        r->franjas[i].usadas = 0;
+    }
+    soltarFranjasCambios(r);
+}
+
+static inline uint64_t versionCambios(RegistroCambios* r) {
+    return atomic_load(&r->version);
+}
+
+static inline void anotarCambio(RegistroCambios* r, int clave, int tipo) {
+    FranjaCambios* f = franjaCambios(r, clave);
+    pthread_mutex_lock(&f->candado);
+    uint64_t version = atomic_fetch_add(&r->version, 1) + 1;
+    if (f->usadas == f->capacidad) {
+        size_t capacidad = f->capacidad ? f->capacidad * 2 : 1024;
+        if (capacidad > r->limite / FRANJAS_CAMBIOS)
+            capacidad = r->limite / FRANJAS_CAMBIOS;
+        AnotacionCambio* mayor = NULL;
+        if (f->capacidad < capacidad)
+            mayor = (AnotacionCambio*)realloc(f->anotaciones, sizeof(AnotacionCambio) * capacidad);
+        if (mayor != NULL) {
+            f->anotaciones = mayor;
+            f->capacidad = capacidad;
+        } else if (f->usadas > 1) {
+            // Lleno (o sin memoria): descartar la mitad mas vieja
+            size_t mitad = f->usadas / 2;
+            f->versionMinima = f->anotaciones[mitad - 1].version;
+            memmove(f->anotaciones, f->anotaciones + mitad, sizeof(AnotacionCambio) * (f->usadas - mitad));
+            f->usadas -= mitad;
+        } else {
+            f->versionMinima = version;
+            f->usadas = 0;
+        }
+    }
+    if (f->usadas < f->capacidad) {
+        AnotacionCambio* a = &f->anotaciones[f->usadas++];
+        a->version = version;
+        a->clave = clave;
+        a->tipo = tipo;
+    }
+    pthread_mutex_unlock(&f->candado);
+}
+
+static inline int compararAnotaciones(const void* a, const void* b) {
+    const AnotacionCambio* x = (const AnotacionCambio*)a;
+    const AnotacionCambio* y = (const AnotacionCambio*)b;
+    if (x->clave != y->clave)
+        return x->clave < y->clave ? -1 : 1;
+    return x->version < y->version ? -1 : (x->version > y->version);
+}
+
+// Primera anotacion de la franja posterior a 'desde'
+static inline size_t primeraPosterior(const FranjaCambios* f, uint64_t desde) {
+    size_t bajo = 0, alto = f->usadas;
+    while (bajo < alto) {
+        size_t medio = bajo + (alto - bajo) / 2;
+        if (f->anotaciones[medio].version <= desde)
+            bajo = medio + 1;
+        else
+            alto = medio;
+    }
+    return bajo;
+}
+
+// Cambios netos desde la version 'desde', en orden de clave (el llamador
+// libera *cambios). Devuelve cuantos hay, o -1 si esa version ya no esta
+// cubierta y hace falta un reporte completo. *hasta queda con la version
+// que cubre la respuesta.
+static inline long cambiosDesde(RegistroCambios* r, uint64_t desde, CambioNeto** cambios, uint64_t* hasta) {
+    size_t inicio[FRANJAS_CAMBIOS];
+    size_t n = 0;
+    *cambios = NULL;
+    // Con todas las franjas tomadas, cada version hasta *hasta ya esta anotada
+    tomarFranjasCambios(r);
+    *hasta = atomic_load(&r->version);
+    int cubierta = desde <= *hasta;
+    for (int i = 0; i < FRANJAS_CAMBIOS && cubierta; i++) {
+        cubierta = desde >= r->franjas[i].versionMinima;
+        inicio[i] = primeraPosterior(&r->franjas[i], desde);
+        n += r->franjas[i].usadas - inicio[i];
+    }
+    AnotacionCambio* tramo = cubierta ? (AnotacionCambio*)malloc(sizeof(AnotacionCambio) * (n ? n : 1)) : NULL;
+    if (tramo == NULL) {
+        soltarFranjasCambios(r);
+        return -1;
+    }
+    n = 0;
+    for (int i = 0; i < FRANJAS_CAMBIOS; i++) {
+        const FranjaCambios* f = &r->franjas[i];
+        if (f->usadas > inicio[i]) {
+            memcpy(tramo + n, f->anotaciones + inicio[i], sizeof(AnotacionCambio) * (f->usadas - inicio[i]));
+            n += f->usadas - inicio[i];
+        }
+    }
+    soltarFranjasCambios(r);
+
+    // Por clave: existia antes si su primer cambio no fue un alta, existe
+    // ahora si el ultimo no fue una baja
+    qsort(tramo, n, sizeof(AnotacionCambio), compararAnotaciones);
+    CambioNeto* netos = (CambioNeto*)malloc(sizeof(CambioNeto) * (n ? n : 1));
+    if (netos == NULL) {
+        free(tramo);
+        return -1;
+    }
+    long total = 0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j + 1 < n && tramo[j + 1].clave == tramo[i].clave)
+            j++;
+        int antes = tramo[i].tipo != CAMBIO_ALTA;
+        int ahora = tramo[j].tipo != CAMBIO_BAJA;
+        if (antes || ahora) {
+            netos[total].clave = tramo[i].clave;
+            netos[total].tipo = !antes ? CAMBIO_ALTA : !ahora ? CAMBIO_BAJA : CAMBIO_MODIFICACION;
+            total++;
+        }
+        i = j + 1;
+    }
+    free(tramo);
+    *cambios = netos;
+    return total;
+}
+
+static inline void liberarRegistroCambios(RegistroCambios* r) {
+    for (int i = 0; i < FRANJAS_CAMBIOS; i++) {
+        FranjaCambios* f = &r->franjas[i];
+        free(f->anotaciones);
+        f->anotaciones = NULL;
+        f->usadas = 0;
+        f->capacidad = 0;
+    }
+}
+
+#endif
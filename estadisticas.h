@@ -0,0 +1,106 @@
+// Contadores e histogramas de latencia para los motores de arboles.
+// Con la recoleccion apagada cada punto de medicion cuesta una comparacion;
+// compilando con -DSIN_ESTADISTICAS desaparece por completo.
+#ifndef ESTADISTICAS_H
+#define ESTADISTICAS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CUBETAS_HISTOGRAMA 40   // Cubeta i: latencias en [2^i, 2^(i+1)) ns
+
+// Histograma logaritmico de latencias en nanosegundos
+typedef struct Histograma {
+    uint64_t cubetas[CUBETAS_HISTOGRAMA];
+    uint64_t total;
+    uint64_t sumaNs;
+} Histograma;
+
+#ifdef SIN_ESTADISTICAS
+#define ESTADISTICAS_ACTIVAS 0
+#else
+static int estadisticasActivas = 0;
+#define ESTADISTICAS_ACTIVAS __builtin_expect(estadisticasActivas, 0)
+#endif
+
+// Sumar a un contador (seguro entre hilos)
+#define EST_SUMAR(contador, n) \
+    do { if (ESTADISTICAS_ACTIVAS) __atomic_fetch_add(&(contador), (n), __ATOMIC_RELAXED); } while (0)
+
+// Guardar el maximo observado en un contador
+#define EST_MAXIMO(contador, valor) \
+    do { if (ESTADISTICAS_ACTIVAS) maximoAtomico(&(contador), (uint64_t)(valor)); } while (0)
+
+// Medir la latencia de una operacion entre EST_INICIO y EST_FIN
+#define EST_INICIO(marca) uint64_t marca = ESTADISTICAS_ACTIVAS ? relojEstadisticasNs() : 0
+#define EST_FIN(histograma, marca) \
+    do { if (marca) agregarLatencia(&(histograma), relojEstadisticasNs() - (marca)); } while (0)
+
+static inline uint64_t relojEstadisticasNs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+static inline void maximoAtomico(uint64_t* contador, uint64_t valor) {
+    uint64_t actual = __atomic_load_n(contador, __ATOMIC_RELAXED);
+    while (valor > actual &&
+           !__atomic_compare_exchange_n(contador, &actual, valor, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static inline void agregarLatencia(Histograma* h, uint64_t ns) {
+    int cubeta = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (cubeta >= CUBETAS_HISTOGRAMA)
+        cubeta = CUBETAS_HISTOGRAMA - 1;
+    __atomic_fetch_add(&h->cubetas[cubeta], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sumaNs, ns, __ATOMIC_RELAXED);
+}
+
+// Cota superior (en ns) de la cubeta donde cae el percentil p
+static inline uint64_t percentilHistograma(const Histograma* h, double p) {
+    uint64_t objetivo = (uint64_t)(p * (double)h->total);
+    uint64_t acumulado = 0;
+    for (int i = 0; i < CUBETAS_HISTOGRAMA; i++) {
+        acumulado += h->cubetas[i];
+        if (acumulado > objetivo)
+            return (2ull << i) - 1;
+    }
+    return 0;
+}
+
+static inline void imprimirHistograma(FILE* salida, const char* nombre, const Histograma* h) {
+    if (h->total == 0) {
+        fprintf(salida, "  %-12s sin muestras\n", nombre);
+        return;
+    }
+    fprintf(salida, "  %-12s n=%-10llu media=%-8llu p50<=%-8llu p99<=%-8llu p999<=%llu ns\n",
+            nombre, (unsigned long long)h->total,
+            (unsigned long long)(h->sumaNs / h->total),
+            (unsigned long long)percentilHistograma(h, 0.50),
+            (unsigned long long)percentilHistograma(h, 0.99),
+            (unsigned long long)percentilHistograma(h, 0.999));
+}
+
+// Encender la recoleccion; devuelve 0 si se compilo sin estadisticas
+static inline int activarEstadisticas(void) {
+#ifdef SIN_ESTADISTICAS
+    return 0;
+#else
+    estadisticasActivas = 1;
+    return 1;
+#endif
+}
+
+// Activar la recoleccion si la variable de entorno ESTADISTICAS vale 1
+static inline void activarEstadisticasDesdeEntorno(void) {
+#ifndef SIN_ESTADISTICAS
+    const char* valor = getenv("ESTADISTICAS");
+    estadisticasActivas = valor != NULL && valor[0] == '1';
+#endif
+}
+
+#endif
@@ -0,0 +1,309 @@
+// Exportacion de listados de gran volumen. Los registros se arman campo a
+// campo en un buffer grande y se vuelcan con write(), sin pasar por printf
+// ni por stdio. Formatos:
+//   CSV         encabezado con nombres; texto entre comillas si hace falta
+//   ANCHO FIJO  cada campo ocupa exactamente su ancho (numeros a la derecha;
+//               si no caben, la columna va llena de '*'; el texto se corta
+//               sin partir caracteres UTF-8)
+//   BINARIO     "EDNMANI1" + uint16 campos + (tipo, nombre) por campo; luego
+//               cada registro: enteros y fechas int32, texto uint8 largo + bytes
+//               (enteros en el orden de bytes del equipo)
+// Un exportador en memoria no vuelca nada: su buffer crece y luego se anexa
+// a otro exportador (asi se arman por partes listados ordenados en paralelo).
+#ifndef EXPORTADOR_H
+#define EXPORTADOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define EXPORTADOR_BUFFER (1 << 20)
+#define MAGIA_MANIFIESTO "EDNMANI1"
+
+enum { EXPORTAR_CSV = 1, EXPORTAR_ANCHO_FIJO, EXPORTAR_BINARIO };
+enum { CAMPO_ENTERO = 1, CAMPO_TEXTO, CAMPO_FECHA };
+
+typedef struct Exportador {
+    int fd;                     // -1 si exporta en memoria
+    int formato;
+    int cerrarFd;               // 0 si escribe en la salida estandar
+    char* buffer;
+    size_t usados;
+    size_t capacidad;
+    int campo;                  // Campo actual dentro del registro
+    long registros;
+    int error;
+} Exportador;
+
+// Pares de digitos "00".."99" para formatear dos cifras por division
+static const char DIGITOS_PARES[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline void escribirDescriptor(Exportador* e, const char* datos, size_t largo) {
+    size_t escrito = 0;
+    while (escrito < largo && !e->error) {
+        ssize_t n = write(e->fd, datos + escrito, largo - escrito);
+        if (n >= 0)
+            escrito += (size_t)n;
+        else if (errno != EINTR)
+            e->error = 1;
+    }
+}
+
+static inline void vaciarExportador(Exportador* e) {
+    escribirDescriptor(e, e->buffer, e->usados);
+    e->usados = 0;
+}
+
+// En archivo se vuelca; en memoria (o si un solo bloque no cabe en el
+// buffer vacio) el buffer crece. Devuelve 0 si el exportador quedo con error
+static inline int hacerEspacio(Exportador* e, size_t n) {
+    if (e->fd >= 0)
+        vaciarExportador(e);
+    if (e->error)
+        return 0;
+    if (e->usados + n <= e->capacidad)
+        return 1;
+    size_t capacidad = e->capacidad ? e->capacidad * 2 : 4096;
+    while (capacidad < e->usados + n)
+        capacidad *= 2;
+    char* buffer = (char*)realloc(e->buffer, capacidad);
+    if (buffer == NULL) {
+        e->error = 1;
+        return 0;
+    }
+    e->buffer = buffer;
+    e->capacidad = capacidad;
+    return 1;
+}
+
+// Espacio para n bytes en el buffer, o NULL si el exportador tiene error
+// (quien llama deja de escribir; el error sale al cerrar)
+static inline char* reservarExportador(Exportador* e, size_t n) {
+    if (e->usados + n > e->capacidad && !hacerEspacio(e, n))
+        return NULL;
+    char* p = e->buffer + e->usados;
+    e->usados += n;
+    return p;
+}
+
+static inline void escribirBytes(Exportador* e, const void* datos, size_t n) {
+    char* p = reservarExportador(e, n);
+    if (p != NULL)
+        memcpy(p, datos, n);
+}
+
+static inline void escribirCaracter(Exportador* e, char c) {
+    char* p = reservarExportador(e, 1);
+    if (p != NULL)
+        *p = c;
+}
+
+// Rellenar con c hasta n bytes
+static inline void rellenarExportador(Exportador* e, char c, size_t n) {
+    char* p = reservarExportador(e, n);
+    if (p != NULL)
+        memset(p, c, n);
+}
+
+// Largo en bytes de a lo sumo 'maximo' bytes del texto sin partir un
+// caracter UTF-8 (no se corta antes de un byte de continuacion)
+static inline size_t largoUtf8(const char* texto, size_t largo, size_t maximo) {
+    if (largo <= maximo)
+        return largo;
+    while (maximo > 0 && ((unsigned char)texto[maximo] & 0xC0) == 0x80)
+        maximo--;
+    return maximo;
+}
+
+// Escribir un entero sin signo en base 10; devuelve cuantos digitos usa
+static inline int formatearEntero(char* destino, uint32_t v) {
+    char tmp[10];
+    int i = 10;
+    while (v >= 100) {
+        uint32_t par = (v % 100) * 2;
+        v /= 100;
+        tmp[--i] = DIGITOS_PARES[par + 1];
+        tmp[--i] = DIGITOS_PARES[par];
+    }
+    if (v >= 10) {
+        tmp[--i] = DIGITOS_PARES[v * 2 + 1];
+        tmp[--i] = DIGITOS_PARES[v * 2];
+    } else {
+        tmp[--i] = (char)('0' + v);
+    }
+    memcpy(destino, tmp + i, 10 - i);
+    return 10 - i;
+}
+
+// Abrir un destino de exportacion; ruta "-" es la salida estandar
+static inline int abrirExportador(Exportador* e, const char* ruta, int formato) {
+    memset(e, 0, sizeof(Exportador));
+    e->formato = formato;
+    if (strcmp(ruta, "-") == 0) {
+        fflush(stdout);
+        e->fd = STDOUT_FILENO;
+    } else {
+        e->fd = open(ruta, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        e->cerrarFd = 1;
+    }
+    if (e->fd < 0)
+        return 0;
+    e->buffer = (char*)malloc(EXPORTADOR_BUFFER);
+    e->capacidad = EXPORTADOR_BUFFER;
+    return e->buffer != NULL;
+}
+
+// Exportador que acumula en memoria, para anexarlo despues a otro
+static inline int abrirExportadorMemoria(Exportador* e, int formato, size_t capacidadInicial) {
+    memset(e, 0, sizeof(Exportador));
+    e->fd = -1;
+    e->formato = formato;
+    e->capacidad = capacidadInicial > 0 ? capacidadInicial : 4096;
+    e->buffer = (char*)malloc(e->capacidad);
+    return e->buffer != NULL;
+}
+
+// Copiar los registros acumulados en memoria al final de otro exportador
+static inline void anexarExportador(Exportador* destino, const Exportador* origen) {
+    if (destino->fd >= 0 && destino->usados + origen->usados > destino->capacidad) {
+        // Un bloque grande va directo al archivo, sin copiarlo al buffer
+        vaciarExportador(destino);
+        escribirDescriptor(destino, origen->buffer, origen->usados);
+    } else if (origen->usados > 0) {
+        escribirBytes(destino, origen->buffer, origen->usados);
+    }
+    destino->registros += origen->registros;
+    destino->error |= origen->error;
+}
+
+// Volcar lo pendiente y cerrar; devuelve 0 si hubo errores de escritura
+static inline int cerrarExportador(Exportador* e) {
+    if (e->buffer != NULL && e->fd >= 0)
+        vaciarExportador(e);
+    free(e->buffer);
+    e->buffer = NULL;
+    if (e->cerrarFd && e->fd >= 0)
+        close(e->fd);
+    return !e->error;
+}
+
+static inline void separarCampo(Exportador* e) {
+    if (e->campo++ > 0 && e->formato == EXPORTAR_CSV)
+        escribirCaracter(e, ',');
+}
+
+static inline void campoEntero(Exportador* e, int valor, int ancho) {
+    separarCampo(e);
+    if (e->formato == EXPORTAR_BINARIO) {
+        int32_t v = valor;
+        escribirBytes(e, &v, 4);
+        return;
+    }
+    char tmp[12];
+    int n = 0;
+    uint32_t absoluto = valor < 0 ? 0u - (uint32_t)valor : (uint32_t)valor;
+    if (valor < 0)
+        tmp[n++] = '-';
+    n += formatearEntero(tmp + n, absoluto);
+    if (e->formato == EXPORTAR_ANCHO_FIJO && n > ancho) {
+        // No cabe: se marca la columna con '*' en vez de correr las siguientes
+        rellenarExportador(e, '*', (size_t)ancho);
+        return;
+    }
+    if (e->formato == EXPORTAR_ANCHO_FIJO && n < ancho)
+        rellenarExportador(e, ' ', (size_t)(ancho - n));
+    escribirBytes(e, tmp, (size_t)n);
+}
+
+// Fecha AAAAMMDD como AAAA-MM-DD
+static inline void campoFecha(Exportador* e, int fecha, int ancho) {
+    separarCampo(e);
+    if (e->formato == EXPORTAR_BINARIO) {
+        int32_t v = fecha;
+        escribirBytes(e, &v, 4);
+        return;
+    }
+    if (e->formato == EXPORTAR_ANCHO_FIJO && ancho < 10) {
+        rellenarExportador(e, '*', (size_t)ancho);
+        return;
+    }
+    if (e->formato == EXPORTAR_ANCHO_FIJO && ancho > 10)
+        rellenarExportador(e, ' ', (size_t)(ancho - 10));
+    unsigned anio = (unsigned)fecha / 10000 % 10000;
+    unsigned mes = (unsigned)fecha / 100 % 100;
+    unsigned dia = (unsigned)fecha % 100;
+    char* p = reservarExportador(e, 10);
+    if (p == NULL)
+        return;
+    memcpy(p, DIGITOS_PARES + (anio / 100) * 2, 2);
+    memcpy(p + 2, DIGITOS_PARES + (anio % 100) * 2, 2);
+    p[4] = '-';
+    memcpy(p + 5, DIGITOS_PARES + mes * 2, 2);
+    p[7] = '-';
+    memcpy(p + 8, DIGITOS_PARES + dia * 2, 2);
+}
+
+static inline void campoTexto(Exportador* e, const char* texto, int ancho) {
+    size_t largo = strlen(texto);
+    separarCampo(e);
+    if (e->formato == EXPORTAR_BINARIO) {
+        uint8_t n = (uint8_t)largoUtf8(texto, largo, 255);
+        escribirCaracter(e, (char)n);
+        escribirBytes(e, texto, n);
+    } else if (e->formato == EXPORTAR_ANCHO_FIJO) {
+        // Un texto largo se corta en un limite de caracter y se rellena
+        size_t n = largoUtf8(texto, largo, (size_t)ancho);
+        char* p = reservarExportador(e, (size_t)ancho);
+        if (p == NULL)
+            return;
+        memcpy(p, texto, n);
+        memset(p + n, ' ', (size_t)ancho - n);
+    } else if (strpbrk(texto, ",\"\n") == NULL) {
+        escribirBytes(e, texto, largo);
+    } else {
+        escribirCaracter(e, '"');
+        for (const char* c = texto; *c; c++) {
+            if (*c == '"')
+                escribirCaracter(e, '"');
+            escribirCaracter(e, *c);
+        }
+        escribirCaracter(e, '"');
+    }
+}
+
+static inline void finRegistro(Exportador* e) {
+    if (e->formato != EXPORTAR_BINARIO)
+        escribirCaracter(e, '\n');
+    e->campo = 0;
+    e->registros++;
+}
+
+// Encabezado con los nombres (y en binario los tipos) de los campos
+static inline void encabezadoExportador(Exportador* e, int numCampos, const char* const* nombres,
+                                        const int* tipos, const int* anchos) {
+    if (e->formato == EXPORTAR_BINARIO) {
+        uint16_t n = (uint16_t)numCampos;
+        escribirBytes(e, MAGIA_MANIFIESTO, 8);
+        escribirBytes(e, &n, 2);
+        for (int i = 0; i < numCampos; i++) {
+            uint8_t largo = (uint8_t)strlen(nombres[i]);
+            escribirCaracter(e, (char)tipos[i]);
+            escribirCaracter(e, (char)largo);
+            escribirBytes(e, nombres[i], largo);
+        }
+        return;
+    }
+    for (int i = 0; i < numCampos; i++)
+        campoTexto(e, nombres[i], anchos[i]);
+    escribirCaracter(e, '\n');
+    e->campo = 0;
+}
+
+#endif
@@ -0,0 +1,140 @@
+// Contabilidad de memoria por estructura y bloques compactos para nodos.
+// Cada estructura (lotes, pedidos, pasajeros) lleva una CuentaMemoria con
+// sus nodos vivos, los bytes que ocupan y lo que el asignador entrego en
+// realidad; la diferencia es la holgura (redondeo de malloc y ranuras
+// muertas en los bloques). La compactacion copia nodos a un BloqueCompacto
+// contiguo; el bloque se libera cuando su ultimo nodo sale de uso.
+#ifndef MEMORIA_H
+#define MEMORIA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+typedef struct CuentaMemoria {
+    int64_t vivos;          // Nodos en uso
+    int64_t bytes;          // Bytes de esos nodos
+    int64_t reservados;     // Bytes entregados por el asignador
+    int64_t compactos;      // Nodos vivos dentro de bloques compactos
+    int64_t bloques;        // Bloques compactos vivos
+    int64_t liberados;      // Nodos liberados desde el arranque (rotacion del heap)
+} CuentaMemoria;
+
+typedef struct BloqueCompacto {
+    CuentaMemoria* cuenta;
+    int64_t vivos;          // Ranuras del bloque aun en uso
+    size_t reservados;
+} BloqueCompacto;
+
+// Las ranuras empiezan alineadas a 16 bytes despues de la cabecera
+#define CABECERA_BLOQUE ((sizeof(BloqueCompacto) + 15) & ~(size_t)15)
+
+// Los contadores se tocan desde varios hilos (muelles, versiones que se cierran)
+static inline void sumarCuenta(int64_t* contador, int64_t n) {
+    __atomic_fetch_add(contador, n, __ATOMIC_RELAXED);
+}
+
+static inline int64_t leerCuenta(const int64_t* contador) {
+    return __atomic_load_n(contador, __ATOMIC_RELAXED);
+}
+
+// Lo que el asignador entrego para un pedido de 'tam' bytes; fuera de glibc
+// no se puede consultar y se cuenta lo pedido (la holgura de malloc no se ve)
+static inline size_t tamanoReservado(void* p, size_t tam) {
+#ifdef __GLIBC__
+    (void)tam;
+    return malloc_usable_size(p);
+#else
+    (void)p;
+    return tam;
+#endif
+}
+
+// Devolver al sistema las paginas libres del heap, si el asignador lo permite
+static inline void devolverMemoriaLibre(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+// Reservar un nodo suelto
+static inline void* reservarNodo(CuentaMemoria* c, size_t tam) {
+    void* nodo = malloc(tam);
+    if (nodo == NULL)
+        return NULL;
+    sumarCuenta(&c->vivos, 1);
+    sumarCuenta(&c->bytes, (int64_t)tam);
+    sumarCuenta(&c->reservados, (int64_t)tamanoReservado(nodo, tam));
+    return nodo;
+}
+
+// Reservar un bloque para 'nodos' ranuras de 'tam' bytes
+static inline BloqueCompacto* reservarBloque(CuentaMemoria* c, size_t tam, long nodos) {
+    size_t pedido = CABECERA_BLOQUE + tam * (size_t)nodos;
+    BloqueCompacto* b = (BloqueCompacto*)malloc(pedido);
+    if (b == NULL)
+        return NULL;
+    b->cuenta = c;
+    b->vivos = 0;
+    b->reservados = tamanoReservado(b, pedido);
+    sumarCuenta(&c->reservados, (int64_t)b->reservados);
+    sumarCuenta(&c->bloques, 1);
+    return b;
+}
+
+// Ocupar la ranura i del bloque con un nodo nuevo
+static inline void* ranuraBloque(BloqueCompacto* b, size_t tam, long i) {
+    CuentaMemoria* c = b->cuenta;
+    __atomic_fetch_add(&b->vivos, 1, __ATOMIC_RELAXED);
+    sumarCuenta(&c->vivos, 1);
+    sumarCuenta(&c->bytes, (int64_t)tam);
+    sumarCuenta(&c->compactos, 1);
+    return (char*)b + CABECERA_BLOQUE + tam * (size_t)i;
+}
+
+// Soltar un bloque; se libera solo si ninguna ranura quedo en uso
+static inline void soltarBloque(BloqueCompacto* b) {
+    if (__atomic_load_n(&b->vivos, __ATOMIC_ACQUIRE) != 0)
+        return;
+    sumarCuenta(&b->cuenta->reservados, -(int64_t)b->reservados);
+    sumarCuenta(&b->cuenta->bloques, -1);
+    free(b);
+}
+
+// Liberar un nodo, suelto (bloque NULL) o dentro de un bloque compacto
+static inline void liberarNodo(CuentaMemoria* c, void* nodo, BloqueCompacto* bloque, size_t tam) {
+    sumarCuenta(&c->vivos, -1);
+    sumarCuenta(&c->bytes, -(int64_t)tam);
+    sumarCuenta(&c->liberados, 1);
+    if (bloque == NULL) {
+        sumarCuenta(&c->reservados, -(int64_t)tamanoReservado(nodo, tam));
+        free(nodo);
+        return;
+    }
+    sumarCuenta(&c->compactos, -1);
+    if (__atomic_sub_fetch(&bloque->vivos, 1, __ATOMIC_ACQ_REL) == 0) {
+        sumarCuenta(&c->reservados, -(int64_t)bloque->reservados);
+        sumarCuenta(&c->bloques, -1);
+        free(bloque);
+    }
+}
+
+// Fraccion de lo reservado que no ocupan nodos vivos
+static inline double holguraCuenta(const CuentaMemoria* c) {
+    int64_t reservados = leerCuenta(&c->reservados);
+    return reservados > 0 ? (double)(reservados - leerCuenta(&c->bytes)) / reservados : 0.0;
+}
+
+static inline void imprimirCuentaMemoria(FILE* salida, const char* nombre, const CuentaMemoria* c) {
+    int64_t reservados = leerCuenta(&c->reservados), bytes = leerCuenta(&c->bytes);
+    fprintf(salida, "  %-10s %9lld nodos %11lld bytes %11lld reservados  holgura %lld (%.1f%%)"
+                    "  compactos %lld en %lld bloques\n",
+            nombre, (long long)leerCuenta(&c->vivos), (long long)bytes, (long long)reservados,
+            (long long)(reservados - bytes), 100.0 * holguraCuenta(c),
+            (long long)leerCuenta(&c->compactos), (long long)leerCuenta(&c->bloques));
+}
+
+#endif
@@ -0,0 +1,357 @@
+// Recorridos paralelos de arboles binarios de busqueda para reportes de
+// cierre. El arbol se parte por subarboles a cierta profundidad; cada parte
+// (un subarbol y el nodo que le sigue en orden) se recorre en un hilo del
+// pool con su propio buffer de salida y sus propios acumulados. Cada parte
+// terminada se anexa a la salida en cuanto terminan las anteriores, asi que
+// la salida es identica a la de un recorrido in-order secuencial y en
+// memoria solo quedan las partes adelantadas. Sirve para cualquier tipo de
+// nodo: se indican los desplazamientos de sus punteros izquierdo y derecho.
+#ifndef RECORRIDO_H
+#define RECORRIDO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "exportador.h"
+
+#define MAX_HILOS_RECORRIDO 64
+#define PARTES_POR_HILO 8       // Mas partes que hilos reparte mejor los subarboles desparejos
+#define CLAVE_TABLA 80
+#define SUMAS_RECORRIDO 4
+
+// ---------- Conteos por clave de texto ----------
+typedef struct EntradaConteo {
+    char clave[CLAVE_TABLA];
+    int ocupada;
+    long long conteo;
+    long long suma;
+} EntradaConteo;
+
+// Direccionamiento abierto con sondeo lineal; capacidad potencia de 2
+typedef struct TablaConteo {
+    EntradaConteo* entradas;
+    size_t capacidad;
+    size_t usadas;
+} TablaConteo;
+
+static inline uint32_t hashClave(const char* clave) {
+    uint32_t h = 2166136261u;
+    for (; *clave; clave++) {
+        h ^= (unsigned char)*clave;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline EntradaConteo* ubicarClave(EntradaConteo* entradas, size_t capacidad, const char* clave) {
+    size_t mascara = capacidad - 1;
+    size_t i = hashClave(clave) & mascara;
+    while (entradas[i].ocupada && strcmp(entradas[i].clave, clave) != 0)
+        i = (i + 1) & mascara;
+    return &entradas[i];
+}
+
+static inline void crecerTabla(TablaConteo* t) {
+    size_t capacidad = t->capacidad ? t->capacidad * 2 : 64;
+    EntradaConteo* entradas = (EntradaConteo*)calloc(capacidad, sizeof(EntradaConteo));
+    for (size_t i = 0; i < t->capacidad; i++)
+        if (t->entradas[i].ocupada)
+            *ubicarClave(entradas, capacidad, t->entradas[i].clave) = t->entradas[i];
+    free(t->entradas);
+    t->entradas = entradas;
+    t->capacidad = capacidad;
+}
+
+// Sumar a la entrada de una clave (las claves deben caber en CLAVE_TABLA)
+static inline void sumarEnTabla(TablaConteo* t, const char* clave, long long conteo, long long suma) {
+    if ((t->usadas + 1) * 10 > t->capacidad * 7)
+        crecerTabla(t);
+    EntradaConteo* e = ubicarClave(t->entradas, t->capacidad, clave);
+    if (!e->ocupada) {
+        size_t largo = strlen(clave);
+        memcpy(e->clave, clave, largo < CLAVE_TABLA ? largo : CLAVE_TABLA - 1);
+        e->ocupada = 1;
+        t->usadas++;
+    }
+    e->conteo += conteo;
+    e->suma += suma;
+}
+
+static inline void fusionarTablas(TablaConteo* destino, const TablaConteo* origen) {
+    for (size_t i = 0; i < origen->capacidad; i++)
+        if (origen->entradas[i].ocupada)
+            sumarEnTabla(destino, origen->entradas[i].clave, origen->entradas[i].conteo,
+                         origen->entradas[i].suma);
+}
+
+static inline int compararEntradas(const void* a, const void* b) {
+    return strcmp(((const EntradaConteo*)a)->clave, ((const EntradaConteo*)b)->clave);
+}
+
+// Copia de las entradas ordenadas por clave; el llamador la libera
+static inline EntradaConteo* ordenarTabla(const TablaConteo* t) {
+    EntradaConteo* ordenadas = (EntradaConteo*)malloc(sizeof(EntradaConteo) * (t->usadas + 1));
+    size_t n = 0;
+    for (size_t i = 0; i < t->capacidad; i++)
+        if (t->entradas[i].ocupada)
+            ordenadas[n++] = t->entradas[i];
+    qsort(ordenadas, n, sizeof(EntradaConteo), compararEntradas);
+    return ordenadas;
+}
+
+static inline void liberarTabla(TablaConteo* t) {
+    free(t->entradas);
+    memset(t, 0, sizeof(TablaConteo));
+}
+
+// ---------- Recorrido por partes ----------
+// Lo que acumula cada parte; el significado de las sumas lo da quien visita
+typedef struct ParcialRecorrido {
+    Exportador salida;          // Solo si el recorrido exporta
+    TablaConteo tabla;
+    long long sumas[SUMAS_RECORRIDO];
+    long long nodos;
+} ParcialRecorrido;
+
+typedef void (*VisitarNodo)(const void* nodo, ParcialRecorrido* parcial, void* contexto);
+
+typedef struct RecorridoParalelo {
+    size_t despIzquierda;       // offsetof del hijo izquierdo
+    size_t despDerecha;
+    VisitarNodo visitar;
+    void* contexto;
+    int formato;                // Formato de exportacion, 0 si no escribe salida
+} RecorridoParalelo;
+
+typedef struct ParteRecorrido {
+    const void* subarbol;
+    const void* siguiente;      // Nodo que sigue al subarbol en orden, o NULL
+    int terminada;              // Protegida por candadoSalida
+    ParcialRecorrido parcial;
+} ParteRecorrido;
+
+typedef struct PoolRecorrido {
+    pthread_t hilos[MAX_HILOS_RECORRIDO];
+    int numHilos;               // Hilos auxiliares; quien llama tambien trabaja
+    pthread_mutex_t candado;
+    pthread_cond_t hayTrabajo;
+    pthread_cond_t terminado;
+    unsigned long generacion;   // Cambia con cada trabajo nuevo
+    int cerrando;
+    int activos;                // Auxiliares que aun no terminan el trabajo actual
+    const RecorridoParalelo* recorrido;
+    ParteRecorrido* partes;
+    int numPartes;
+    atomic_int siguienteParte;
+    pthread_mutex_t candadoSalida;
+    Exportador* salida;         // Destino de las partes, o NULL
+    int parteAnexar;            // Primera parte aun no anexada
+} PoolRecorrido;
+
+static inline const void* hijoNodo(const void* nodo, size_t desplazamiento) {
+    return *(const void* const*)((const char*)nodo + desplazamiento);
+}
+
+static inline void recorrerSubarbol(const RecorridoParalelo* r, const void* nodo, ParcialRecorrido* parcial) {
+    while (nodo != NULL) {
+        recorrerSubarbol(r, hijoNodo(nodo, r->despIzquierda), parcial);
+        r->visitar(nodo, parcial, r->contexto);
+        parcial->nodos++;
+        nodo = hijoNodo(nodo, r->despDerecha);
+    }
+}
+
+static inline void recorrerParte(const RecorridoParalelo* r, ParteRecorrido* parte) {
+    recorrerSubarbol(r, parte->subarbol, &parte->parcial);
+    if (parte->siguiente != NULL) {
+        r->visitar(parte->siguiente, &parte->parcial, r->contexto);
+        parte->parcial.nodos++;
+    }
+}
+
+// Marcar la parte como terminada y anexar, en orden, las que ya no esperan
+// a ninguna anterior; su buffer se libera al anexarla
+static inline void entregarParte(PoolRecorrido* pool, int i) {
+    pthread_mutex_lock(&pool->candadoSalida);
+    pool->partes[i].terminada = 1;
+    while (pool->parteAnexar < pool->numPartes && pool->partes[pool->parteAnexar].terminada) {
+        Exportador* parte = &pool->partes[pool->parteAnexar].parcial.salida;
+        if (pool->salida != NULL)
+            anexarExportador(pool->salida, parte);
+        cerrarExportador(parte);
+        pool->parteAnexar++;
+    }
+    pthread_mutex_unlock(&pool->candadoSalida);
+}
+
+// Tomar partes hasta que no quede ninguna
+static inline void trabajarPartes(PoolRecorrido* pool) {
+    int i;
+    while ((i = atomic_fetch_add(&pool->siguienteParte, 1)) < pool->numPartes) {
+        recorrerParte(pool->recorrido, &pool->partes[i]);
+        if (pool->recorrido->formato != 0)
+            entregarParte(pool, i);
+    }
+}
+
+static inline void* hiloRecorrido(void* arg) {
+    PoolRecorrido* pool = (PoolRecorrido*)arg;
+    unsigned long visto = 0;
+    pthread_mutex_lock(&pool->candado);
+    while (1) {
+        while (pool->generacion == visto && !pool->cerrando)
+            pthread_cond_wait(&pool->hayTrabajo, &pool->candado);
+        if (pool->cerrando)
+            break;
+        visto = pool->generacion;
+        pthread_mutex_unlock(&pool->candado);
+        trabajarPartes(pool);
+        pthread_mutex_lock(&pool->candado);
+        if (--pool->activos == 0)
+            pthread_cond_signal(&pool->terminado);
+    }
+    pthread_mutex_unlock(&pool->candado);
+    return NULL;
+}
+
+static inline int hilosDisponibles(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n > MAX_HILOS_RECORRIDO ? MAX_HILOS_RECORRIDO : (int)n;
+}
+
+// Pool de hilos para recorridos; hilos cuenta tambien al que llama
+static inline void iniciarPoolRecorrido(PoolRecorrido* pool, int hilos) {
+    memset(pool, 0, sizeof(PoolRecorrido));
+    pthread_mutex_init(&pool->candado, NULL);
+    pthread_cond_init(&pool->hayTrabajo, NULL);
+    pthread_cond_init(&pool->terminado, NULL);
+    pthread_mutex_init(&pool->candadoSalida, NULL);
+    if (hilos > MAX_HILOS_RECORRIDO)
+        hilos = MAX_HILOS_RECORRIDO;
+    for (int i = 0; i < hilos - 1; i++) {
+        if (pthread_create(&pool->hilos[i], NULL, hiloRecorrido, pool) != 0)
+            break;
+        pool->numHilos++;
+    }
+}
+
+static inline void detenerPoolRecorrido(PoolRecorrido* pool) {
+    pthread_mutex_lock(&pool->candado);
+    pool->cerrando = 1;
+    pthread_cond_broadcast(&pool->hayTrabajo);
+    pthread_mutex_unlock(&pool->candado);
+    for (int i = 0; i < pool->numHilos; i++)
+        pthread_join(pool->hilos[i], NULL);
+    pthread_mutex_destroy(&pool->candado);
+    pthread_cond_destroy(&pool->hayTrabajo);
+    pthread_cond_destroy(&pool->terminado);
+    pthread_mutex_destroy(&pool->candadoSalida);
+}
+
+// Cortar el arbol a la profundidad dada: subarbol, nodo, subarbol, nodo...
+static inline void partirEnPartes(const RecorridoParalelo* r, const void* nodo, int profundidad,
+                                  ParteRecorrido* partes, int* numPartes) {
+    if (profundidad == 0 || nodo == NULL) {
+        partes[*numPartes].subarbol = nodo;
+        partes[*numPartes].siguiente = NULL;
+        (*numPartes)++;
+        return;
+    }
+    partirEnPartes(r, hijoNodo(nodo, r->despIzquierda), profundidad - 1, partes, numPartes);
+    partes[*numPartes - 1].siguiente = nodo;
+    partirEnPartes(r, hijoNodo(nodo, r->despDerecha), profundidad - 1, partes, numPartes);
+}
+
+static inline void iniciarParcial(ParcialRecorrido* parcial) {
+    memset(parcial, 0, sizeof(ParcialRecorrido));
+}
+
+static inline void liberarParcial(ParcialRecorrido* parcial) {
+    liberarTabla(&parcial->tabla);
+    if (parcial->salida.buffer != NULL)
+        cerrarExportador(&parcial->salida);
+}
+
+// Sin hilos auxiliares (o sin memoria para las partes) el recorrido va
+// directo sobre total y escribe directo en salida
+static inline void recorrerSecuencial(const RecorridoParalelo* r, const void* raiz,
+                                      ParcialRecorrido* total, Exportador* salida) {
+    Exportador propia = total->salida;
+    if (r->formato != 0)
+        total->salida = *salida;
+    recorrerSubarbol(r, raiz, total);
+    if (r->formato != 0) {
+        *salida = total->salida;
+        total->salida = propia;
+    }
+}
+
+// Recorrer el arbol en paralelo. Los acumulados de las partes se suman en
+// total (iniciado por el llamador) y, si el recorrido exporta, su salida se
+// anexa en orden a salida (que entonces no puede ser NULL). El arbol no debe
+// cambiar durante el recorrido.
+static inline void recorrerEnParalelo(PoolRecorrido* pool, const RecorridoParalelo* r, const void* raiz,
+                                      ParcialRecorrido* total, Exportador* salida) {
+    int hilos = pool->numHilos + 1;
+    if (hilos == 1) {
+        recorrerSecuencial(r, raiz, total, salida);
+        return;
+    }
+    int profundidad = 0;
+    while ((1 << profundidad) < hilos * PARTES_POR_HILO)
+        profundidad++;
+
+    ParteRecorrido* partes = (ParteRecorrido*)calloc((size_t)1 << profundidad, sizeof(ParteRecorrido));
+    if (partes == NULL) {
+        recorrerSecuencial(r, raiz, total, salida);
+        return;
+    }
+    int numPartes = 0;
+    partirEnPartes(r, raiz, profundidad, partes, &numPartes);
+    if (r->formato != 0) {
+        for (int i = 0; i < numPartes; i++) {
+            if (!abrirExportadorMemoria(&partes[i].parcial.salida, r->formato, 1 << 16)) {
+                for (int k = 0; k <= i; k++)
+                    cerrarExportador(&partes[k].parcial.salida);
+                free(partes);
+                recorrerSecuencial(r, raiz, total, salida);
+                return;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&pool->candado);
+    pool->recorrido = r;
+    pool->partes = partes;
+    pool->numPartes = numPartes;
+    pool->salida = salida;
+    pool->parteAnexar = 0;
+    atomic_store(&pool->siguienteParte, 0);
+    pool->activos = pool->numHilos;
+    pool->generacion++;
+    pthread_cond_broadcast(&pool->hayTrabajo);
+    pthread_mutex_unlock(&pool->candado);
+
+    trabajarPartes(pool);
+    pthread_mutex_lock(&pool->candado);
+    while (pool->activos > 0)
+        pthread_cond_wait(&pool->terminado, &pool->candado);
+    pthread_mutex_unlock(&pool->candado);
+
+    // La salida ya esta anexada; quedan los acumulados
+    for (int i = 0; i < numPartes; i++) {
+        ParcialRecorrido* p = &partes[i].parcial;
+        for (int k = 0; k < SUMAS_RECORRIDO; k++)
+            total->sumas[k] += p->sumas[k];
+        total->nodos += p->nodos;
+        fusionarTablas(&total->tabla, &p->tabla);
+        liberarParcial(p);
+    }
+    free(partes);
+}
+
+#endif
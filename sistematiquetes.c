@@ -1,43 +1,115 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "estadisticas.h"
+#include "exportador.h"
+#include "recorrido.h"
+#include "memoria.h"
+#include "cambios.h"
 
 // Definición de la estructura del nodo Pasajero
 typedef struct Pasajero {
     int documento;
     char destino[50];
     char tipo_pasaje[20];
+    int altura;                     // Altura del subarbol (indice balanceado AVL)
+    BloqueCompacto *bloque;         // Bloque compacto que lo contiene (NULL: malloc propio)
     struct Pasajero *izq;
     struct Pasajero *der;
 } Pasajero;
 
+// Contadores del indice (se llenan solo con la recoleccion encendida)
+typedef struct EstadisticasABB {
+    uint64_t descensos;
+    uint64_t nodosVisitados;
+    uint64_t profundidadMaxima;     // Nivel mas profundo alcanzado por una insercion
+    uint64_t duplicados;
+    uint64_t rotaciones;
+    uint64_t nodosCreados, nodosLiberados;
+    Histograma insertar, eliminar;
+} EstadisticasABB;
+
+EstadisticasABB estadisticas;
+
+// Memoria que ocupan los nodos del indice
+CuentaMemoria memoriaPasajeros;
+
+// Pasajeros registrados o eliminados, para listar solo lo nuevo desde el ultimo listado
+#define LIMITE_CAMBIOS (1 << 20)
+RegistroCambios cambiosPasajeros = REGISTRO_CAMBIOS(LIMITE_CAMBIOS);
+
 // Función para crear un nuevo nodo Pasajero
-Pasajero* crearPasajero(int documento, char destino[], char tipo_pasaje[]) {
-    Pasajero *nuevo = (Pasajero*)malloc(sizeof(Pasajero));
+Pasajero* crearPasajero(int documento, const char *destino, const char *tipo_pasaje) {
+    Pasajero *nuevo = (Pasajero*)reservarNodo(&memoriaPasajeros, sizeof(Pasajero));
     if (nuevo == NULL) {
         printf("Error de memoria.\n");
         return NULL;
     }
+    EST_SUMAR(estadisticas.nodosCreados, 1);
     nuevo->documento = documento;
     strcpy(nuevo->destino, destino);
     strcpy(nuevo->tipo_pasaje, tipo_pasaje);
+    nuevo->altura = 1;
+    nuevo->bloque = NULL;
     nuevo->izq = NULL;
     nuevo->der = NULL;
     return nuevo;
 }
 
-// Función para insertar en el ABB
-Pasajero* insertar(Pasajero *raiz, int documento, char destino[], char tipo_pasaje[]) {
-    if (raiz == NULL) {
-        return crearPasajero(documento, destino, tipo_pasaje);
+void liberarPasajero(Pasajero *p) {
+    liberarNodo(&memoriaPasajeros, p, p->bloque, sizeof(Pasajero));
+    EST_SUMAR(estadisticas.nodosLiberados, 1);
+}
+
+// Registrar un pasajero en el manifiesto, anotando el cambio
+Pasajero* altaPasajero(int documento, const char *destino, const char *tipo_pasaje) {
+    Pasajero *nuevo = crearPasajero(documento, destino, tipo_pasaje);
+    if (nuevo != NULL) {
+        anotarCambio(&cambiosPasajeros, documento, CAMBIO_ALTA);
     }
-    if (documento < raiz->documento) {
-        raiz->izq = insertar(raiz->izq, documento, destino, tipo_pasaje);
-    } else if (documento > raiz->documento) {
-        raiz->der = insertar(raiz->der, documento, destino, tipo_pasaje);
-    } else {
+    return nuevo;
+}
+
+// Sacar un pasajero del manifiesto, anotando el cambio
+void bajaPasajero(Pasajero *p) {
+    anotarCambio(&cambiosPasajeros, p->documento, CAMBIO_BAJA);
+    liberarPasajero(p);
+}
+
+// Datos de un pasajero nuevo mientras la insercion busca su lugar
+typedef struct DatosPasajero {
+    const char *destino;
+    const char *tipo_pasaje;
+} DatosPasajero;
+
+// Indice AVL por documento: funciones indice* del nucleo comun
+#define ARBOL_PREFIJO indice
+#define ARBOL_NODO Pasajero
+#define ARBOL_CLAVE_TIPO int
+#define ARBOL_CLAVE(n) ((n)->documento)
+#define ARBOL_IZQ izq
+#define ARBOL_DER der
+#define ARBOL_ALTURA altura
+#define ARBOL_CREAR(clave, datos) \
+    altaPasajero((clave), ((const DatosPasajero *)(datos))->destino, ((const DatosPasajero *)(datos))->tipo_pasaje)
+#define ARBOL_LIBERAR(n) bajaPasajero(n)
+#define ARBOL_VISITA() EST_SUMAR(estadisticas.nodosVisitados, 1)
+#define ARBOL_AL_ROTAR() EST_SUMAR(estadisticas.rotaciones, 1)
+#define ARBOL_PROFUNDIDAD(p) EST_MAXIMO(estadisticas.profundidadMaxima, (p))
+#include "arbol_avl.h"
+
+// Función para insertar en el índice
+Pasajero* insertar(Pasajero *raiz, int documento, char destino[], char tipo_pasaje[]) {
+    DatosPasajero datos = {destino, tipo_pasaje};
+    Pasajero *existente;
+    EST_INICIO(inicio);
+    EST_SUMAR(estadisticas.descensos, 1);
+    raiz = indiceInsertar(raiz, documento, &datos, &existente);
+    if (existente != NULL) {
+        EST_SUMAR(estadisticas.duplicados, 1);
         printf("Documento %d ya existe. No se inserta.\n", documento);
     }
+    EST_FIN(estadisticas.insertar, inicio);
     return raiz;
 }
 
@@ -68,6 +140,99 @@ void postorden(Pasajero *raiz) {
     }
 }
 
+// Listar solo lo que cambio desde un listado anterior, por documento:
+// + registrado, - eliminado, * eliminado y vuelto a registrar. Devuelve
+// cuantos cambios hubo, o -1 si esa version ya no esta en el registro.
+long listarCambios(Pasajero *raiz, uint64_t desde, uint64_t *hasta) {
+    CambioNeto *cambios;
+    long n = cambiosDesde(&cambiosPasajeros, desde, &cambios, hasta);
+    for (long i = 0; i < n; i++) {
+        Pasajero *p = cambios[i].tipo == CAMBIO_BAJA ? NULL : indiceBuscar(raiz, cambios[i].clave);
+        if (p == NULL) {
+            printf("- Documento: %d\n", cambios[i].clave);
+        } else {
+            printf("%c Documento: %d, Destino: %s, Tipo: %s\n", cambios[i].tipo == CAMBIO_ALTA ? '+' : '*',
+                   p->documento, p->destino, p->tipo_pasaje);
+        }
+    }
+    free(cambios);
+    return n;
+}
+
+void exportarPasajero(Exportador *e, const Pasajero *p) {
+    campoEntero(e, p->documento, 12);
+    campoTexto(e, p->destino, 20);
+    campoTexto(e, p->tipo_pasaje, 15);
+    finRegistro(e);
+}
+
+// Escribir los pasajeros en orden de documento, directo desde el recorrido
+void exportarPasajeros(Exportador *e, Pasajero *raiz) {
+    if (raiz != NULL) {
+        exportarPasajeros(e, raiz->izq);
+        exportarPasajero(e, raiz);
+        exportarPasajeros(e, raiz->der);
+    }
+}
+
+void visitarPasajeroExportado(const void *nodo, ParcialRecorrido *parcial, void *contexto) {
+    (void)contexto;
+    exportarPasajero(&parcial->salida, (const Pasajero *)nodo);
+}
+
+// Exportar el manifiesto completo; devuelve los registros escritos o -1.
+// Con un pool de varios hilos, las partes del indice se escriben en paralelo
+// y se anexan en orden; con uno solo se escribe directo desde el recorrido.
+long exportarManifiesto(Pasajero *raiz, const char *ruta, int formato, PoolRecorrido *pool) {
+    static const char *nombres[] = {"documento", "destino", "tipo_pasaje"};
+    static const int tipos[] = {CAMPO_ENTERO, CAMPO_TEXTO, CAMPO_TEXTO};
+    static const int anchos[] = {12, 20, 15};
+    Exportador e;
+    if (!abrirExportador(&e, ruta, formato)) {
+        cerrarExportador(&e);
+        return -1;
+    }
+    encabezadoExportador(&e, 3, nombres, tipos, anchos);
+    if (pool != NULL && pool->numHilos > 0) {
+        RecorridoParalelo r = {offsetof(Pasajero, izq), offsetof(Pasajero, der),
+                               visitarPasajeroExportado, NULL, formato};
+        ParcialRecorrido total;
+        iniciarParcial(&total);
+        recorrerEnParalelo(pool, &r, raiz, &total, &e);
+        liberarParcial(&total);
+    } else {
+        exportarPasajeros(&e, raiz);
+    }
+    long registros = e.registros;
+    return cerrarExportador(&e) ? registros : -1;
+}
+
+// Pasajeros por destino y tarifa en un recorrido paralelo; la tabla usa la
+// clave "destino / tarifa" y las sumas separan los tiquetes de ida de los de
+// ida y regreso
+#define SUMA_IDA 0
+#define SUMA_IDA_REGRESO 1
+
+void acumularPasajero(const void *nodo, ParcialRecorrido *parcial, void *contexto) {
+    const Pasajero *p = (const Pasajero *)nodo;
+    char clave[CLAVE_TABLA];
+    size_t largoDestino = strlen(p->destino), largoTipo = strlen(p->tipo_pasaje);
+    (void)contexto;
+    memcpy(clave, p->destino, largoDestino);
+    memcpy(clave + largoDestino, " / ", 3);
+    memcpy(clave + largoDestino + 3, p->tipo_pasaje, largoTipo + 1);
+    sumarEnTabla(&parcial->tabla, clave, 1, 0);
+    parcial->sumas[strcmp(p->tipo_pasaje, "Ida") == 0 ? SUMA_IDA : SUMA_IDA_REGRESO]++;
+}
+
+// Resumir el manifiesto (el llamador libera el resultado con liberarParcial)
+void resumirManifiesto(PoolRecorrido *pool, Pasajero *raiz, ParcialRecorrido *total) {
+    RecorridoParalelo r = {offsetof(Pasajero, izq), offsetof(Pasajero, der),
+                           acumularPasajero, NULL, 0};
+    iniciarParcial(total);
+    recorrerEnParalelo(pool, &r, raiz, total, NULL);
+}
+
 // Función para contar el total de pasajeros
 int contarPasajeros(Pasajero *raiz) {
     if (raiz == NULL) {
@@ -76,42 +241,178 @@ int contarPasajeros(Pasajero *raiz) {
     return 1 + contarPasajeros(raiz->izq) + contarPasajeros(raiz->der);
 }
 
-// Función para encontrar el nodo mínimo (para eliminación)
-Pasajero* encontrarMinimo(Pasajero *raiz) {
-    Pasajero *actual = raiz;
-    while (actual && actual->izq != NULL) {
-        actual = actual->izq;
+// Función para eliminar un pasajero por documento
+Pasajero* eliminar(Pasajero *raiz, int documento) {
+    EST_INICIO(inicio);
+    EST_SUMAR(estadisticas.descensos, 1);
+    raiz = indiceEliminar(raiz, documento);
+    EST_FIN(estadisticas.eliminar, inicio);
+    return raiz;
+}
+
+// ================= DIVISIÓN Y UNIÓN DE MANIFIESTOS =================
+// Operan reenlazando nodos, sin copiarlos (indicePartir, indiceConcatenar e
+// indiceUnirConPivote del nucleo comun).
+
+// Dividir un manifiesto por rango: documentos < documento en *menores y
+// documentos >= documento en *desde
+void dividirManifiesto(Pasajero *raiz, int documento, Pasajero **menores, Pasajero **desde) {
+    Pasajero *encontrado = indicePartir(raiz, documento, menores, desde);
+    if (encontrado != NULL) {
+        *desde = indiceUnirConPivote(NULL, encontrado, *desde);
+    }
+}
+
+// Fusionar dos manifiestos cualesquiera. Los pasajeros de b cuyo documento
+// ya esta en a no se insertan: se encadenan por 'der' en *duplicados (sin
+// liberarlos) y se cuentan en *numDuplicados.
+Pasajero* fusionarManifiestos(Pasajero *a, Pasajero *b, Pasajero **duplicados, int *numDuplicados) {
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    Pasajero *izqA = a->izq;
+    Pasajero *derA = a->der;
+    Pasajero *izqB, *derB;
+    Pasajero *repetido = indicePartir(b, a->documento, &izqB, &derB);
+    if (repetido != NULL) {
+        repetido->der = *duplicados;
+        *duplicados = repetido;
+        (*numDuplicados)++;
     }
-    return actual;
+    Pasajero *izq = fusionarManifiestos(izqA, izqB, duplicados, numDuplicados);
+    Pasajero *der = fusionarManifiestos(derA, derB, duplicados, numDuplicados);
+    return indiceUnirConPivote(izq, a, der);
 }
 
-// Función para eliminar un pasajero por documento
-Pasajero* eliminar(Pasajero *raiz, int documento) {
-    if (raiz == NULL) {
+// Unir dos manifiestos. Si los rangos de documentos no se traslapan es una
+// concatenacion O(log n); si se traslapan se hace la fusion con duplicados.
+Pasajero* unirManifiestos(Pasajero *a, Pasajero *b, Pasajero **duplicados, int *numDuplicados) {
+    *duplicados = NULL;
+    *numDuplicados = 0;
+    if (a == NULL || b == NULL) {
+        return a ? a : b;
+    }
+    if (indiceMaximo(a)->documento < indiceMinimo(b)->documento) {
+        return indiceConcatenar(a, b);
+    }
+    if (indiceMaximo(b)->documento < indiceMinimo(a)->documento) {
+        return indiceConcatenar(b, a);
+    }
+    return fusionarManifiestos(a, b, duplicados, numDuplicados);
+}
+
+// ================= LOTES DE RESERVAS Y CANCELACIONES =================
+// Un lote nocturno se ordena por documento y se aplica de una sola pasada:
+// el indice se parte en el documento central del lote, cada mitad del lote
+// se aplica a su mitad del indice y los resultados se vuelven a unir. Los
+// subarboles sin mutaciones no se visitan, y cada union reequilibra una sola
+// vez; el costo es O(m log(n/m + 1)) en lugar de O(m log n).
+#define MUTACION_RESERVA 1
+#define MUTACION_CANCELACION 2
+
+#define RESULTADO_APLICADO 0
+#define RESULTADO_DUPLICADO 1       // Reserva de un documento que ya existe
+#define RESULTADO_NO_ENCONTRADO 2   // Cancelacion de un documento inexistente
+#define RESULTADO_SIN_MEMORIA 3
+
+typedef struct Mutacion {
+    int tipo;
+    int documento;
+    char destino[50];
+    char tipo_pasaje[20];
+    int resultado;                  // Lo llena aplicarLote
+} Mutacion;
+
+// Posicion de una mutacion en el lote, ordenada por documento
+typedef struct ClaveMutacion {
+    int documento;
+    int posicion;
+} ClaveMutacion;
+
+// Orden por documento; a igual documento se respeta el orden del lote
+int compararMutaciones(const void *a, const void *b) {
+    const ClaveMutacion *x = (const ClaveMutacion *)a;
+    const ClaveMutacion *y = (const ClaveMutacion *)b;
+    if (x->documento != y->documento) {
+        return x->documento < y->documento ? -1 : 1;
+    }
+    return x->posicion < y->posicion ? -1 : (x->posicion > y->posicion);
+}
+
+// Aplicar en orden las mutaciones de un mismo documento sobre su nodo
+// (NULL si no esta en el indice); devuelve el nodo que queda
+Pasajero* aplicarMutacionesDocumento(Pasajero *nodo, Mutacion *lote, const ClaveMutacion *orden, int n) {
+    for (int i = 0; i < n; i++) {
+        Mutacion *m = &lote[orden[i].posicion];
+        if (m->tipo == MUTACION_RESERVA) {
+            if (nodo != NULL) {
+                EST_SUMAR(estadisticas.duplicados, 1);
+                m->resultado = RESULTADO_DUPLICADO;
+            } else {
+                nodo = altaPasajero(m->documento, m->destino, m->tipo_pasaje);
+                m->resultado = nodo ? RESULTADO_APLICADO : RESULTADO_SIN_MEMORIA;
+            }
+        } else if (nodo == NULL) {
+            m->resultado = RESULTADO_NO_ENCONTRADO;
+        } else {
+            bajaPasajero(nodo);
+            nodo = NULL;
+            m->resultado = RESULTADO_APLICADO;
+        }
+    }
+    return nodo;
+}
+
+// Aplicar mutaciones ya ordenadas a un subarbol
+Pasajero* aplicarOrdenado(Pasajero *raiz, Mutacion *lote, const ClaveMutacion *orden, int n) {
+    if (n == 0) {
         return raiz;
     }
-    if (documento < raiz->documento) {
-        raiz->izq = eliminar(raiz->izq, documento);
-    } else if (documento > raiz->documento) {
-        raiz->der = eliminar(raiz->der, documento);
-    } else {
-        // Caso 1: Nodo sin hijos o con un hijo
-        if (raiz->izq == NULL) {
-            Pasajero *temp = raiz->der;
-            free(raiz);
-            return temp;
-        } else if (raiz->der == NULL) {
-            Pasajero *temp = raiz->izq;
-            free(raiz);
-            return temp;
+    // Grupo de mutaciones del documento central
+    int inicio = n / 2, fin = n / 2 + 1;
+    int documento = orden[inicio].documento;
+    while (inicio > 0 && orden[inicio - 1].documento == documento) {
+        inicio--;
+    }
+    while (fin < n && orden[fin].documento == documento) {
+        fin++;
+    }
+    Pasajero *menores, *mayores;
+    Pasajero *nodo = indicePartir(raiz, documento, &menores, &mayores);
+    nodo = aplicarMutacionesDocumento(nodo, lote, orden + inicio, fin - inicio);
+    menores = aplicarOrdenado(menores, lote, orden, inicio);
+    mayores = aplicarOrdenado(mayores, lote, orden + fin, n - fin);
+    if (nodo != NULL) {
+        return indiceUnirConPivote(menores, nodo, mayores);
+    }
+    return indiceConcatenar(menores, mayores);
+}
+
+// Aplicar un lote de reservas y cancelaciones. Cada mutacion queda con su
+// resultado; las de un mismo documento se aplican en el orden del lote.
+Pasajero* aplicarLote(Pasajero *raiz, Mutacion *lote, int n) {
+    if (n <= 0) {
+        return raiz;
+    }
+    ClaveMutacion *orden = (ClaveMutacion *)malloc(sizeof(ClaveMutacion) * n);
+    if (orden == NULL) {
+        printf("Error de memoria.\n");
+        for (int i = 0; i < n; i++) {
+            lote[i].resultado = RESULTADO_SIN_MEMORIA;
         }
-        // Caso 2: Nodo con dos hijos
-        Pasajero *temp = encontrarMinimo(raiz->der);
-        raiz->documento = temp->documento;
-        strcpy(raiz->destino, temp->destino);
-        strcpy(raiz->tipo_pasaje, temp->tipo_pasaje);
-        raiz->der = eliminar(raiz->der, temp->documento);
+        return raiz;
     }
+    for (int i = 0; i < n; i++) {
+        orden[i].documento = lote[i].documento;
+        orden[i].posicion = i;
+    }
+    qsort(orden, n, sizeof(ClaveMutacion), compararMutaciones);
+    EST_SUMAR(estadisticas.descensos, 1);
+    raiz = aplicarOrdenado(raiz, lote, orden, n);
+    free(orden);
     return raiz;
 }
 
@@ -120,8 +421,179 @@ void liberarArbol(Pasajero *raiz) {
     if (raiz != NULL) {
         liberarArbol(raiz->izq);
         liberarArbol(raiz->der);
-        free(raiz);
+        liberarPasajero(raiz);
+    }
+}
+
+// ================= MEMORIA Y COMPACTACIÓN =================
+// Tras mucho insertar y eliminar, los nodos quedan dispersos en el heap.
+// Compactar copia el indice a un solo bloque contiguo en orden de documento
+// (el orden en que lo recorren los listados y exportaciones) y libera los
+// nodos viejos; las claves y la forma del arbol no cambian.
+
+// Copiar un subarbol a las ranuras siguientes del bloque; devuelve su nueva raiz
+Pasajero* reubicarPasajeros(Pasajero *raiz, BloqueCompacto *bloque, long *siguiente) {
+    if (raiz == NULL) {
+        return NULL;
+    }
+    Pasajero *izq = reubicarPasajeros(raiz->izq, bloque, siguiente);
+    Pasajero *nuevo = (Pasajero*)ranuraBloque(bloque, sizeof(Pasajero), (*siguiente)++);
+    *nuevo = *raiz;
+    nuevo->bloque = bloque;
+    nuevo->izq = izq;
+    nuevo->der = reubicarPasajeros(raiz->der, bloque, siguiente);
+    // Se reemplaza, no sale del manifiesto: no se anota como baja
+    EST_SUMAR(estadisticas.nodosCreados, 1);
+    liberarPasajero(raiz);
+    return nuevo;
+}
+
+// Compactar el indice; si no hay memoria para el bloque queda como estaba
+Pasajero* compactarIndice(Pasajero *raiz) {
+    int total = contarPasajeros(raiz);
+    if (total == 0) {
+        return raiz;
+    }
+    BloqueCompacto *bloque = reservarBloque(&memoriaPasajeros, sizeof(Pasajero), total);
+    if (bloque == NULL) {
+        printf("Error de memoria.\n");
+        return raiz;
     }
+    long siguiente = 0;
+    return reubicarPasajeros(raiz, bloque, &siguiente);
+}
+
+#ifndef SIN_MAIN
+// Volcar los contadores del indice
+void imprimirEstadisticas(Pasajero *raiz) {
+    EstadisticasABB *e = &estadisticas;
+    int total = contarPasajeros(raiz);
+    int alto = indiceAltura(raiz);
+    printf("\n--- Estadísticas del índice ---\n");
+    printf("Pasajeros: %d | Altura: %d", total, alto);
+    if (total > 0) {
+        // Un arbol balanceado tendria altura cercana a log2(n) + 1
+        printf(" (balanceado: %d)", 32 - __builtin_clz((unsigned)total));
+    }
+    printf("\n");
+    printf("Descensos: %llu | Nodos visitados por descenso: %.2f\n",
+           (unsigned long long)e->descensos,
+           e->descensos ? (double)e->nodosVisitados / e->descensos : 0.0);
+    printf("Profundidad máxima de inserción: %llu | Duplicados rechazados: %llu\n",
+           (unsigned long long)e->profundidadMaxima, (unsigned long long)e->duplicados);
+    printf("Rotaciones: %llu\n", (unsigned long long)e->rotaciones);
+    printf("Nodos creados/liberados: %llu/%llu\n",
+           (unsigned long long)e->nodosCreados, (unsigned long long)e->nodosLiberados);
+    printf("Latencias:\n");
+    imprimirHistograma(stdout, "insertar", &e->insertar);
+    imprimirHistograma(stdout, "eliminar", &e->eliminar);
+}
+
+// Resumen del manifiesto por destino y tarifa
+void imprimirResumen(PoolRecorrido *pool, Pasajero *raiz) {
+    ParcialRecorrido total;
+    resumirManifiesto(pool, raiz, &total);
+    printf("\n--- Resumen del manifiesto (%d hilos) ---\n", pool->numHilos + 1);
+    printf("Pasajeros: %lld | Ida: %lld | Ida y Regreso: %lld\n", total.nodos,
+           total.sumas[SUMA_IDA], total.sumas[SUMA_IDA_REGRESO]);
+    EntradaConteo *grupos = ordenarTabla(&total.tabla);
+    for (size_t i = 0; i < total.tabla.usadas; i++)
+        printf("  %-30s %lld\n", grupos[i].clave, grupos[i].conteo);
+    free(grupos);
+    liberarParcial(&total);
+}
+
+// Memoria del indice: nodos, bytes y holgura del asignador
+void imprimirMemoria(void) {
+    printf("\n--- Memoria del índice ---\n");
+    imprimirCuentaMemoria(stdout, "pasajeros", &memoriaPasajeros);
+}
+
+// Leer un archivo de lote: una mutacion por linea, "R documento destino tipo"
+// (destino 1-4 y tipo 1-2 como en el menu) o "C documento". Las lineas mal
+// formadas se informan y se omiten. Devuelve el lote (o NULL) y su tamaño en *n.
+Mutacion* leerLote(const char *ruta, char destinos[][50], int *n) {
+    FILE *f = fopen(ruta, "r");
+    *n = 0;
+    if (f == NULL) {
+        printf("No se pudo abrir %s.\n", ruta);
+        return NULL;
+    }
+    int capacidad = 1024, numLinea = 0;
+    Mutacion *lote = (Mutacion *)malloc(sizeof(Mutacion) * capacidad);
+    char linea[128];
+    while (lote != NULL && fgets(linea, sizeof(linea), f) != NULL) {
+        char letra;
+        int documento, dest = 0, tipo = 0;
+        numLinea++;
+        int campos = sscanf(linea, " %c %d %d %d", &letra, &documento, &dest, &tipo);
+        if (campos < 1) {
+            continue;   // Linea en blanco
+        }
+        int valida = (letra == 'C' && campos >= 2) ||
+                     (letra == 'R' && campos == 4 && dest >= 1 && dest <= 4 && tipo >= 1 && tipo <= 2);
+        if (!valida) {
+            printf("Línea %d no válida: %s", numLinea, linea);
+            continue;
+        }
+        if (*n == capacidad) {
+            capacidad *= 2;
+            Mutacion *mayor = (Mutacion *)realloc(lote, sizeof(Mutacion) * capacidad);
+            if (mayor == NULL) {
+                free(lote);
+                lote = NULL;
+                break;
+            }
+            lote = mayor;
+        }
+        Mutacion *m = &lote[(*n)++];
+        m->documento = documento;
+        m->destino[0] = '\0';
+        m->tipo_pasaje[0] = '\0';
+        if (letra == 'R') {
+            m->tipo = MUTACION_RESERVA;
+            strcpy(m->destino, destinos[dest - 1]);
+            strcpy(m->tipo_pasaje, tipo == 1 ? "Ida" : "Ida y Regreso");
+        } else {
+            m->tipo = MUTACION_CANCELACION;
+        }
+    }
+    fclose(f);
+    if (lote == NULL) {
+        printf("Error de memoria.\n");
+        *n = 0;
+    }
+    return lote;
+}
+
+// Aplicar un archivo de lote e informar lo que no se pudo aplicar
+Pasajero* procesarArchivoLote(Pasajero *raiz, const char *ruta, char destinos[][50]) {
+    int n;
+    Mutacion *lote = leerLote(ruta, destinos, &n);
+    if (lote == NULL) {
+        return raiz;
+    }
+    raiz = aplicarLote(raiz, lote, n);
+    int conteo[4] = {0, 0, 0, 0};
+    for (int i = 0; i < n; i++) {
+        Mutacion *m = &lote[i];
+        conteo[m->resultado]++;
+        if (m->resultado == RESULTADO_DUPLICADO) {
+            printf("Documento %d ya existe. No se inserta.\n", m->documento);
+        } else if (m->resultado == RESULTADO_NO_ENCONTRADO) {
+            printf("Documento %d no existe. No se cancela.\n", m->documento);
+        } else if (m->resultado == RESULTADO_SIN_MEMORIA) {
+            printf("Documento %d no se registró por falta de memoria.\n", m->documento);
+        }
+    }
+    printf("Lote aplicado: %d mutaciones | Aplicadas: %d | Duplicadas: %d | No encontradas: %d",
+           n, conteo[RESULTADO_APLICADO], conteo[RESULTADO_DUPLICADO], conteo[RESULTADO_NO_ENCONTRADO]);
+    if (conteo[RESULTADO_SIN_MEMORIA] > 0) {
+        printf(" | Sin memoria: %d", conteo[RESULTADO_SIN_MEMORIA]);
+    }
+    printf("\n");
+    free(lote);
+    return raiz;
 }
 
 int main() {
@@ -130,6 +602,12 @@ int main() {
     char destino[50], tipo_pasaje[20];
     char destinos[4][50] = {"Timbiquí", "Juanchaco", "Tumaco", "Guapi"};
 
+    activarEstadisticasDesdeEntorno();
+    PoolRecorrido pool;
+    iniciarPoolRecorrido(&pool, hilosDisponibles());
+    iniciarVersionCambios(&cambiosPasajeros);
+    uint64_t versionListada = versionCambios(&cambiosPasajeros);
+
     do {
         printf("\n--- Sistema de Gestión de Tiquetes ---\n");
         printf("1. Registrar pasajero\n");
@@ -139,6 +617,12 @@ int main() {
         printf("5. Contar pasajeros\n");
         printf("6. Eliminar pasajero\n");
         printf("7. Salir\n");
+        printf("8. Estadísticas del índice\n");
+        printf("9. Exportar manifiesto\n");
+        printf("10. Resumen por destino y tarifa\n");
+        printf("11. Aplicar lote de reservas y cancelaciones\n");
+        printf("12. Memoria y compactación del índice\n");
+        printf("13. Cambios desde el último listado\n");
         printf("Seleccione una opción: ");
         scanf("%d", &opcion);
 
@@ -168,14 +652,17 @@ int main() {
                 break;
             case 2:
                 printf("Listado Inorden:\n");
+                versionListada = versionCambios(&cambiosPasajeros);
                 inorden(raiz);
                 break;
             case 3:
                 printf("Listado Preorden:\n");
+                versionListada = versionCambios(&cambiosPasajeros);
                 preorden(raiz);
                 break;
             case 4:
                 printf("Listado Postorden:\n");
+                versionListada = versionCambios(&cambiosPasajeros);
                 postorden(raiz);
                 break;
             case 5:
@@ -190,10 +677,77 @@ int main() {
                 printf("Saliendo...\n");
                 liberarArbol(raiz);
                 break;
+            case 8:
+                if (ESTADISTICAS_ACTIVAS) {
+                    imprimirEstadisticas(raiz);
+                } else if (activarEstadisticas()) {
+                    printf("Recolección de estadísticas activada desde ahora.\n");
+                } else {
+                    printf("Este ejecutable se compiló sin estadísticas.\n");
+                }
+                break;
+            case 9: {
+                char ruta[256];
+                int formato;
+                printf("Archivo de salida (- para pantalla): ");
+                scanf("%255s", ruta);
+                printf("Formato (1. CSV, 2. Ancho fijo, 3. Binario): ");
+                scanf("%d", &formato);
+                if (formato < EXPORTAR_CSV || formato > EXPORTAR_BINARIO) {
+                    printf("Formato no válido.\n");
+                    break;
+                }
+                long registros = exportarManifiesto(raiz, ruta, formato, &pool);
+                if (registros < 0) {
+                    printf("Error al exportar el manifiesto.\n");
+                } else {
+                    printf("Manifiesto exportado: %ld pasajeros.\n", registros);
+                }
+                break;
+            }
+            case 10:
+                imprimirResumen(&pool, raiz);
+                break;
+            case 11: {
+                char ruta[256];
+                printf("Archivo del lote: ");
+                scanf("%255s", ruta);
+                raiz = procesarArchivoLote(raiz, ruta, destinos);
+                break;
+            }
+            case 12: {
+                imprimirMemoria();
+                printf("¿Compactar el índice? (1. Sí, 2. No): ");
+                int compactar;
+                scanf("%d", &compactar);
+                if (compactar == 1) {
+                    raiz = compactarIndice(raiz);
+                    imprimirMemoria();
+                }
+                break;
+            }
+            case 13: {
+                uint64_t version;
+                printf("Cambios desde el último listado:\n");
+                long cambios = listarCambios(raiz, versionListada, &version);
+                if (cambios < 0) {
+                    printf("El registro de cambios ya no cubre el último listado. Liste de nuevo.\n");
+                } else {
+                    if (cambios == 0) {
+                        printf("Sin cambios.\n");
+                    }
+                    versionListada = version;
+                }
+                break;
+            }
             default:
                 printf("Opción no válida.\n");
         }
     } while (opcion != 7);
 
+    detenerPoolRecorrido(&pool);
+    liberarRegistroCambios(&cambiosPasajeros);
+
     return 0;
 }
+#endif